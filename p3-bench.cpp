@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "p3.h"
+
+/*Microbenchmarks for the primitives of the LICM engine, on synthetic loop
+  nests whose body size, load/store/call mix and depth are set by options.
+  Every benchmark builds fresh IR outside the timed region, runs one warm-up
+  pass and then repeats until -min-time-ms of timed work; the median time
+  per operation is reported. Cycles and instructions come from
+  perf_event_open when the kernel allows it. Like p3-fuzz this links the
+  engine by building p3.cpp with P3_NO_MAIN.*/
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+        LoopSize("loop-size",
+                 cl::desc("Operations in the body of every synthetic loop."),
+                 cl::init(32));
+
+static cl::opt<unsigned>
+        LoadPercent("loads",
+                    cl::desc("Percentage of body operations that are loads."),
+                    cl::init(30));
+
+static cl::opt<unsigned>
+        StorePercent("stores",
+                     cl::desc("Percentage of body operations that are stores."),
+                     cl::init(10));
+
+static cl::opt<unsigned>
+        CallPercent("calls",
+                    cl::desc("Percentage of body operations that are calls."),
+                    cl::init(5));
+
+static cl::opt<unsigned>
+        Depth("depth",
+              cl::desc("Nest depth of the synthetic loops."),
+              cl::init(2));
+
+static cl::opt<unsigned>
+        Nests("nests",
+              cl::desc("Top-level loop nests in the synthetic function."),
+              cl::init(4));
+
+static cl::opt<unsigned>
+        MinTime("min-time-ms",
+                cl::desc("Timed work per benchmark."),
+                cl::init(200));
+
+static cl::opt<std::string>
+        Filter("filter",
+               cl::desc("Only run the benchmarks whose name matches this regex."),
+               cl::init(""));
+
+/*Emits a loop of LoopSize operations after Preheader, which has no
+  terminator yet, with Levels - 1 loops nested in the middle of its body.
+  Returns the exit block, again without a terminator.*/
+static BasicBlock *emitLoop(Function *F, BasicBlock *Preheader, unsigned Levels, std::mt19937 &Rand,
+                            Function *Clobber, Function *Pure, GlobalVariable *G)
+{
+    LLVMContext &Ctx = F->getContext();
+    Type *I32 = Type::getInt32Ty(Ctx);
+    Value *P = F->getArg(0), *N = F->getArg(1), *K = F->getArg(2);
+    BasicBlock *Header = BasicBlock::Create(Ctx, "loop", F);
+    BranchInst::Create(Header, Preheader);
+
+    IRBuilder<> B(Header);
+    PHINode *IV = B.CreatePHI(I32, 2, "i");
+    IV->addIncoming(ConstantInt::get(I32, 0), Preheader);
+    Value *Acc = K;
+
+    for (unsigned op = 0; op < LoopSize; op++) {
+        if (Levels > 1 && op == LoopSize / 2) {
+            BasicBlock *Exit = emitLoop(F, B.GetInsertBlock(), Levels - 1, Rand, Clobber, Pure, G);
+            B.SetInsertPoint(Exit);
+        }
+        unsigned pick = Rand() % 100;
+        bool invariant = Rand() % 2;
+        if (pick < LoadPercent) {
+            Value *Ptr = invariant ? (Value *)G : B.CreateGEP(I32, P, IV);
+            Acc = B.CreateAdd(Acc, B.CreateLoad(I32, Ptr));
+        } else if (pick < LoadPercent + StorePercent) {
+            B.CreateStore(Acc, invariant ? (Value *)G : B.CreateGEP(I32, P, IV));
+        } else if (pick < LoadPercent + StorePercent + CallPercent) {
+            if (invariant) Acc = B.CreateCall(Pure, {Acc});
+            else B.CreateCall(Clobber);
+        } else {
+            Acc = B.CreateAdd(Acc, invariant ? B.CreateMul(K, N) : IV);
+        }
+    }
+
+    Value *Next = B.CreateAdd(IV, ConstantInt::get(I32, 1));
+    IV->addIncoming(Next, B.GetInsertBlock());
+    BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", F);
+    B.CreateCondBr(B.CreateICmpSLT(Next, N), Header, Exit);
+    return Exit;
+}
+
+/*Builds the same synthetic module for every call*/
+static std::unique_ptr<Module> synthesize(LLVMContext &Ctx)
+{
+    std::mt19937 Rand(1);
+    auto M = std::make_unique<Module>("bench", Ctx);
+    Type *I32 = Type::getInt32Ty(Ctx);
+    Type *Void = Type::getVoidTy(Ctx);
+
+    Function *Clobber = Function::Create(FunctionType::get(Void, false), Function::ExternalLinkage, "clobber", M.get());
+    Function *Pure = Function::Create(FunctionType::get(I32, {I32}, false), Function::ExternalLinkage, "pure", M.get());
+    Pure->setOnlyReadsMemory();
+    Pure->setDoesNotThrow();
+    auto *G = new GlobalVariable(*M, I32, false, GlobalValue::ExternalLinkage, ConstantInt::get(I32, 0), "g");
+
+    FunctionType *FTy = FunctionType::get(Void, {PointerType::getUnqual(I32), I32, I32}, false);
+    Function *F = Function::Create(FTy, Function::ExternalLinkage, "f", M.get());
+    BasicBlock *BB = BasicBlock::Create(Ctx, "entry", F);
+    for (unsigned n = 0; n < Nests; n++)
+        BB = emitLoop(F, BB, std::max(1u, (unsigned)Depth), Rand, Clobber, Pure, G);
+    ReturnInst::Create(Ctx, BB);
+    return M;
+}
+
+/*Cycles and instructions of the calling thread, or nothing if
+  perf_event_open is not permitted*/
+class Counters {
+    int Fds[2] = {-1, -1};
+
+public:
+    uint64_t Values[2] = {0, 0};
+
+    Counters() {
+        uint64_t Configs[2] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS};
+        for (int c = 0; c < 2; c++) {
+            perf_event_attr Attr;
+            memset(&Attr, 0, sizeof(Attr));
+            Attr.size = sizeof(Attr);
+            Attr.type = PERF_TYPE_HARDWARE;
+            Attr.config = Configs[c];
+            Attr.disabled = 1;
+            Attr.exclude_kernel = 1;
+            Attr.exclude_hv = 1;
+            Fds[c] = syscall(__NR_perf_event_open, &Attr, 0, -1, -1, 0);
+        }
+    }
+    ~Counters() {
+        for (int fd: Fds) if (fd >= 0) close(fd);
+    }
+    bool available() const { return Fds[0] >= 0 && Fds[1] >= 0; }
+    void start() {
+        for (int fd: Fds) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    void stop() {
+        for (int c = 0; c < 2; c++) {
+            if (Fds[c] < 0) continue;
+            ioctl(Fds[c], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t v = 0;
+            if (read(Fds[c], &v, sizeof(v)) == sizeof(v)) Values[c] = v;
+        }
+    }
+};
+
+/*A benchmark gets a fresh module and returns the number of operations it
+  performed on it; the Timer it gets brackets the part to measure*/
+typedef std::function<void(const std::function<void()> &)> Timer;
+typedef std::function<unsigned(Module &, const Timer &)> Benchmark;
+
+static void run(const char *Name, const Benchmark &Bench)
+{
+    if (!Filter.empty() && !Regex(Filter).match(Name)) return;
+
+    Counters HW;
+    std::vector<double> NsPerOp;
+    uint64_t cycles = 0, instructions = 0, ops = 0;
+    double total = 0;
+    for (unsigned rep = 0; total < MinTime * 1e6 || rep < 2; rep++) {
+        LLVMContext Ctx;
+        std::unique_ptr<Module> M = synthesize(Ctx);
+        double ns = 0;
+        auto Timed = [&](const std::function<void()> &Work) {
+            HW.start();
+            auto Start = std::chrono::steady_clock::now();
+            Work();
+            ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - Start).count();
+            HW.stop();
+        };
+        /*the kernel counts cumulatively, so only the difference is ours*/
+        uint64_t c0 = HW.Values[0], i0 = HW.Values[1];
+        unsigned n = Bench(*M, Timed);
+        /*the first repetition warms up caches and is not reported*/
+        if (rep == 0 || n == 0) continue;
+        total += ns;
+        ops += n;
+        cycles += HW.Values[0] - c0;
+        instructions += HW.Values[1] - i0;
+        NsPerOp.push_back(ns / n);
+    }
+    if (NsPerOp.empty()) return;
+
+    std::sort(NsPerOp.begin(), NsPerOp.end());
+    outs() << format("%-20s %10llu %12.1f", (const char *)Name, (unsigned long long)ops, NsPerOp[NsPerOp.size() / 2]);
+    if (HW.available())
+        outs() << format(" %12.1f %12.1f", (double)cycles / ops, (double)instructions / ops);
+    else
+        outs() << " " << right_justify("-", 12) << " " << right_justify("-", 12);
+    outs() << "\n";
+}
+
+/*The loops of F, innermost first*/
+static std::vector<Loop *> loopsOf(LoopInfo &LI)
+{
+    auto Loops = LI.getLoopsInPreorder();
+    std::reverse(Loops.begin(), Loops.end());
+    return std::vector<Loop *>(Loops.begin(), Loops.end());
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "LICM primitive microbenchmarks\n");
+
+    outs() << left_justify("benchmark", 20) << " " << right_justify("ops", 10) << " " << right_justify("ns/op", 12) << " "
+           << right_justify("cycles/op", 12) << " " << right_justify("instrs/op", 12) << "\n";
+
+    run("canMoveOutOfLoop", [](Module &M, const Timer &Timed) {
+        Function &F = *M.getFunction("f");
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        unsigned n = 0;
+        Timed([&] {
+            for (auto L: loopsOf(LI)) {
+                for (auto bb: L->blocks()) {
+                    for (auto &Inst: *bb) {
+                        if (!isa<LoadInst>(&Inst)) continue;
+                        canMoveOutOfLoop(L, &Inst, &DT);
+                        n++;
+                    }
+                }
+            }
+        });
+        return n;
+    });
+
+    run("instrIsInLoop", [](Module &M, const Timer &Timed) {
+        Function &F = *M.getFunction("f");
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        unsigned n = 0;
+        Timed([&] {
+            for (auto L: loopsOf(LI)) {
+                for (auto &bb: F) {
+                    for (auto &Inst: bb) {
+                        instrIsInLoop(L, &Inst);
+                        n++;
+                    }
+                }
+            }
+        });
+        return n;
+    });
+
+    run("mLICM round", [](Module &M, const Timer &Timed) {
+        Function &F = *M.getFunction("f");
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        unsigned n = 0;
+        for (auto L: loopsOf(LI)) {
+            if (L->getLoopPreheader() == nullptr) continue;
+            Timed([&] { mLICM(L, &DT); });
+            n++;
+        }
+        return n;
+    });
+
+    run("makeLoopInvariant", [](Module &M, const Timer &Timed) {
+        Function &F = *M.getFunction("f");
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        unsigned n = 0;
+        for (auto L: loopsOf(LI)) {
+            if (L->getLoopPreheader() == nullptr) continue;
+            std::vector<Instruction *> Insts;
+            for (auto bb: L->blocks()) {
+                for (auto &Inst: *bb) {
+                    if (!Inst.mayReadOrWriteMemory()) Insts.push_back(&Inst);
+                }
+            }
+            Timed([&] {
+                for (auto I: Insts) {
+                    bool changed = false;
+                    L->makeLoopInvariant(I, changed);
+                }
+            });
+            n += Insts.size();
+        }
+        return n;
+    });
+
+    run("summarize", [](Module &M, const Timer &Timed) {
+        Timed([&] { summarize(&M); });
+        return 1u;
+    });
+
+    run("numStats", [](Module &M, const Timer &Timed) {
+        Timed([&] { numStats(M); });
+        return 1u;
+    });
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+/*Finds the LICM hoists that make a program slower. p3 runs with
+  -licm-limit=N, which applies only the first N hoists, and lli times the
+  result. A binary search over N finds the first hoist that pushes the run
+  time past the unoptimized time plus -tolerance; that hoist is skipped with
+  -licm-skip and the search repeats for up to -max-culprits hoists. The
+  search assumes the slowdown, once caused, stays.*/
+
+using namespace llvm;
+
+static cl::opt<std::string>
+        Program(cl::Positional, cl::Required, cl::desc("<bitcode[:stdin file[:arg,arg...]]>"));
+
+static cl::opt<std::string>
+        P3Args("p3-args",
+               cl::desc("Extra p3 options, separated by spaces, e.g. \"-O3 -mem2reg\"."),
+               cl::init(""));
+
+static cl::opt<unsigned>
+        Repeat("repeat",
+               cl::desc("Runs per measurement; the fastest one counts."),
+               cl::init(5));
+
+static cl::opt<double>
+        Tolerance("tolerance",
+                  cl::desc("Slowdown in percent over the unhoisted program that counts as a regression."),
+                  cl::init(2.0));
+
+static cl::opt<unsigned>
+        MaxCulprits("max-culprits",
+                    cl::desc("Number of regressing hoists to look for."),
+                    cl::init(3));
+
+static cl::opt<unsigned>
+        Timeout("timeout",
+                cl::desc("Seconds before a p3 or lli run counts as failed."),
+                cl::init(60));
+
+static cl::opt<std::string>
+        P3Path("p3",
+               cl::desc("p3 binary (default: the one next to p3-bisect)."),
+               cl::init(""));
+
+static cl::opt<std::string>
+        LLIPath("lli",
+                cl::desc("JIT used to run the optimized programs."),
+                cl::init("lli"));
+
+static std::string Bitcode, Stdin;
+static std::vector<std::string> ProgramArgs;
+static SmallString<128> Optimized, Hoists;
+
+/*Runs Exe with Args, reading stdin from In and writing stdout to Out and
+  stderr to Err. Returns true if it exits with 0 and sets Seconds to its
+  wall time.*/
+static bool runProgram(StringRef Exe, const std::vector<std::string> &Args, StringRef In, StringRef Out,
+                       StringRef Err, double &Seconds)
+{
+    std::vector<StringRef> Argv = {Exe};
+    for (auto &A: Args) Argv.push_back(A);
+    Optional<StringRef> Redirects[] = {In, Out, Err};
+
+    auto Start = std::chrono::steady_clock::now();
+    int rc = sys::ExecuteAndWait(Exe, Argv, None, Redirects, Timeout);
+    Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    return rc == 0;
+}
+
+/*Optimizes the program applying the first Limit hoists that are not in
+  Skip (all of them if Limit is negative) and returns the IDs of the
+  applied hoists in order*/
+static bool optimize(int Limit, const std::vector<std::string> &Skip, std::vector<std::string> &Applied)
+{
+    std::vector<std::string> Args = {Bitcode, Optimized.str().str(), "-licm-print-hoists",
+                                     "-licm-limit=" + itostr(Limit)};
+    if (!Skip.empty()) Args.push_back("-licm-skip=" + join(Skip, ","));
+    SmallVector<StringRef, 8> Extra;
+    StringRef(P3Args).split(Extra, ' ', -1, false);
+    for (auto A: Extra) Args.push_back(A.str());
+
+    double seconds;
+    if (!runProgram(P3Path, Args, "", "", Hoists, seconds)) {
+        errs() << "p3-bisect: p3 failed on " << Bitcode << "\n";
+        return false;
+    }
+    Applied.clear();
+    auto Buf = MemoryBuffer::getFile(Hoists);
+    SmallVector<StringRef, 64> Lines;
+    if (Buf) (*Buf)->getBuffer().split(Lines, '\n');
+    for (auto Line: Lines) {
+        if (Line.consume_front("hoist ")) Applied.push_back(Line.split(' ').first.str());
+    }
+    return true;
+}
+
+/*Returns the fastest of -repeat runs of the optimized program, or a
+  negative value if it fails*/
+static double measure()
+{
+    std::vector<std::string> Args = {Optimized.str().str()};
+    Args.insert(Args.end(), ProgramArgs.begin(), ProgramArgs.end());
+    double best = -1, seconds;
+    for (unsigned r = 0; r < Repeat; r++) {
+        if (!runProgram(LLIPath, Args, Stdin, "", "", seconds)) return -1;
+        if (best < 0 || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+/*Optimizes with Limit and Skip and times the result*/
+static double timeHoists(int Limit, const std::vector<std::string> &Skip, std::vector<std::string> &Applied)
+{
+    if (!optimize(Limit, Skip, Applied)) return -1;
+    return measure();
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "p3 LICM regression bisector\n");
+
+    if (P3Path.empty()) {
+        SmallString<128> Dir(sys::path::parent_path(sys::fs::getMainExecutable(argv[0], (void *)&main)));
+        sys::path::append(Dir, "p3");
+        P3Path = Dir.str().str();
+    }
+    if (auto LLI = sys::findProgramByName(LLIPath)) LLIPath = *LLI;
+
+    SmallVector<StringRef, 3> Fields;
+    StringRef(Program).split(Fields, ':', 2);
+    Bitcode = Fields[0].str();
+    if (Fields.size() > 1) Stdin = Fields[1].str();
+    if (Fields.size() > 2) {
+        SmallVector<StringRef, 4> Args;
+        Fields[2].split(Args, ',', -1, false);
+        for (auto A: Args) ProgramArgs.push_back(A.str());
+    }
+    sys::fs::createTemporaryFile("p3-bisect", "bc", Optimized);
+    sys::fs::createTemporaryFile("p3-bisect", "txt", Hoists);
+
+    std::vector<std::string> Skip, Applied;
+    double baseline = timeHoists(0, Skip, Applied);
+    if (baseline < 0) {
+        errs() << "p3-bisect: the program does not run without hoists\n";
+        return 1;
+    }
+    double bound = baseline * (1 + Tolerance / 100);
+    outs() << "no hoists: " << format("%.6f", baseline) << " s\n";
+
+    int rc = 0;
+    while (Skip.size() < MaxCulprits) {
+        double all = timeHoists(-1, Skip, Applied);
+        outs() << Applied.size() << " hoists: " << format("%.6f", all) << " s\n";
+        if (all < 0) {
+            errs() << "p3-bisect: the optimized program fails\n";
+            rc = 1;
+            break;
+        }
+        if (all <= bound) break;
+
+        /*the first Good hoists are fine, the first Bad are not*/
+        unsigned Good = 0, Bad = Applied.size();
+        while (Bad - Good > 1) {
+            unsigned Mid = Good + (Bad - Good) / 2;
+            double seconds = timeHoists(Mid, Skip, Applied);
+            outs() << "  first " << Mid << ": " << format("%.6f", seconds) << " s\n";
+            if (seconds < 0 || seconds > bound) Bad = Mid;
+            else Good = Mid;
+        }
+        if (!optimize(Bad, Skip, Applied)) {
+            rc = 1;
+            break;
+        }
+        /*slow with every hoist, but no prefix of them is*/
+        if (Bad == 0 || Applied.empty()) {
+            outs() << "regression not attributable to a single hoist\n";
+            break;
+        }
+        outs() << "culprit: " << Applied.back() << "\n";
+        Skip.push_back(Applied.back());
+    }
+    if (!Skip.empty()) outs() << "-licm-skip=" << join(Skip, ",") << "\n";
+
+    sys::fs::remove(Optimized);
+    sys::fs::remove(Optimized + ".stats");
+    sys::fs::remove(Hoists);
+    return rc;
+}
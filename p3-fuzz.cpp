@@ -0,0 +1,335 @@
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "p3.h"
+
+/*Compile-time fuzzer for the LICM engine. Every input is either IR (bitcode
+  or text, so seed corpora can be mutated) or a byte string that is decoded
+  into a module of synthetic loop nests. The engine runs on it, and inputs
+  that cost more than -max-ns-per-inst per IR instruction, or that do not
+  finish within -time-budget-ms, are saved to -regress-dir as the raw input
+  plus the module as .ll so they can become regression cases.
+
+  Built with -DP3_LIBFUZZER=ON this is a libFuzzer target; p3 options go
+  after -ignore_remaining_args=1. Otherwise it runs the given files, or
+  -runs random inputs when no file is given.*/
+
+using namespace llvm;
+
+static cl::opt<std::string>
+        RegressDir("regress-dir",
+                   cl::desc("Directory receiving inputs that exceed the compile-time budget (default: p3-fuzz-slow in the system temporary directory)."),
+                   cl::init(""));
+
+static cl::opt<unsigned>
+        MaxNsPerInst("max-ns-per-inst",
+                     cl::desc("Save inputs on which LICM takes longer than this per IR instruction."),
+                     cl::init(20000));
+
+static cl::opt<unsigned>
+        MaxInstructions("max-instructions",
+                        cl::desc("Skip inputs with more IR instructions than this."),
+                        cl::init(20000));
+
+static cl::opt<unsigned>
+        TimeBudget("time-budget-ms",
+                   cl::desc("Save the input and exit if one LICM run takes longer than this."),
+                   cl::init(10000));
+
+#ifndef P3_LIBFUZZER
+static cl::list<std::string>
+        Inputs(cl::Positional, cl::desc("<input files>"));
+
+static cl::opt<unsigned>
+        Runs("runs",
+             cl::desc("Number of random inputs to try when no input file is given."),
+             cl::init(1000));
+
+static cl::opt<unsigned>
+        Seed("seed",
+             cl::desc("Seed for the random inputs."),
+             cl::init(1));
+#endif
+
+/*Hands out the bytes of the input as bounded choices, 0 once exhausted*/
+struct ByteReader {
+    const uint8_t *Data;
+    size_t Size;
+    size_t Pos = 0;
+
+    ByteReader(const uint8_t *Data, size_t Size) : Data(Data), Size(Size) {}
+    unsigned next(unsigned N) {
+        if (Pos >= Size || N == 0) return 0;
+        return Data[Pos++] % N;
+    }
+};
+
+/*Values a synthetic loop body may use*/
+struct LoopEnv {
+    Function *Clobber;
+    Function *Pure;
+    GlobalVariable *Globals[4];
+    Value *P, *N, *K;
+};
+
+/*Emits a loop after Preheader, which has no terminator yet, and returns its
+  exit block, again without a terminator. The body is a byte-chosen mix of
+  invariant and variant loads, stores, calls, diamonds and inner loops.*/
+static BasicBlock *emitLoop(Function *F, BasicBlock *Preheader, unsigned depth, ByteReader &R, LoopEnv &E)
+{
+    LLVMContext &Ctx = F->getContext();
+    Type *I32 = Type::getInt32Ty(Ctx);
+    BasicBlock *Header = BasicBlock::Create(Ctx, "loop", F);
+    BranchInst::Create(Header, Preheader);
+
+    IRBuilder<> B(Header);
+    PHINode *IV = B.CreatePHI(I32, 2, "i");
+    IV->addIncoming(ConstantInt::get(I32, 0), Preheader);
+    Value *Acc = E.K;
+
+    unsigned nOps = R.next(16);
+    for (unsigned op = 0; op < nOps; op++) {
+        GlobalVariable *G = E.Globals[R.next(4)];
+        switch (R.next(9)) {
+            case 0:
+                Acc = B.CreateAdd(Acc, B.CreateLoad(I32, G));
+                break;
+            case 1:
+                Acc = B.CreateAdd(Acc, B.CreateLoad(I32, B.CreateGEP(I32, E.P, IV)));
+                break;
+            case 2:
+                B.CreateStore(Acc, G);
+                break;
+            case 3:
+                B.CreateStore(Acc, B.CreateGEP(I32, E.P, IV));
+                break;
+            case 4:
+                B.CreateCall(E.Clobber);
+                break;
+            case 5:
+                Acc = B.CreateCall(E.Pure, {Acc});
+                break;
+            case 6:
+                Acc = B.CreateAdd(Acc, B.CreateMul(E.K, E.N));
+                break;
+            case 7: {
+                BasicBlock *Then = BasicBlock::Create(Ctx, "then", F);
+                BasicBlock *Cont = BasicBlock::Create(Ctx, "cont", F);
+                B.CreateCondBr(B.CreateICmpEQ(IV, E.K), Then, Cont);
+                B.SetInsertPoint(Then);
+                B.CreateStore(IV, G);
+                B.CreateBr(Cont);
+                B.SetInsertPoint(Cont);
+                break;
+            }
+            default:
+                if (depth < 4) {
+                    BasicBlock *Exit = emitLoop(F, B.GetInsertBlock(), depth + 1, R, E);
+                    B.SetInsertPoint(Exit);
+                }
+                break;
+        }
+    }
+
+    Value *Next = B.CreateAdd(IV, ConstantInt::get(I32, 1));
+    IV->addIncoming(Next, B.GetInsertBlock());
+    BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", F);
+    B.CreateCondBr(B.CreateICmpSLT(Next, E.N), Header, Exit);
+    return Exit;
+}
+
+static std::unique_ptr<Module> synthesizeLoops(LLVMContext &Ctx, const uint8_t *Data, size_t Size)
+{
+    ByteReader R(Data, Size);
+    auto M = std::make_unique<Module>("fuzz", Ctx);
+    Type *I32 = Type::getInt32Ty(Ctx);
+    Type *Void = Type::getVoidTy(Ctx);
+
+    LoopEnv E;
+    E.Clobber = Function::Create(FunctionType::get(Void, false), Function::ExternalLinkage, "clobber", M.get());
+    E.Pure = Function::Create(FunctionType::get(I32, {I32}, false), Function::ExternalLinkage, "pure", M.get());
+    E.Pure->setOnlyReadsMemory();
+    E.Pure->setDoesNotThrow();
+    for (auto &G: E.Globals)
+        G = new GlobalVariable(*M, I32, false, GlobalValue::ExternalLinkage, ConstantInt::get(I32, 0), "g");
+
+    FunctionType *FTy = FunctionType::get(Void, {PointerType::getUnqual(I32), I32, I32}, false);
+    unsigned nFuncs = 1 + R.next(3);
+    for (unsigned f = 0; f < nFuncs; f++) {
+        Function *F = Function::Create(FTy, Function::ExternalLinkage, "f", M.get());
+        E.P = F->getArg(0);
+        E.N = F->getArg(1);
+        E.K = F->getArg(2);
+        BasicBlock *BB = BasicBlock::Create(Ctx, "entry", F);
+        unsigned nNests = 1 + R.next(4);
+        for (unsigned n = 0; n < nNests; n++)
+            BB = emitLoop(F, BB, 1, R, E);
+        ReturnInst::Create(Ctx, BB);
+    }
+    return M;
+}
+
+static bool looksLikeIR(const uint8_t *Data, size_t Size)
+{
+    StringRef Text(reinterpret_cast<const char *>(Data), Size);
+    return Text.startswith("BC\xC0\xDE") || Text.contains("define ");
+}
+
+static std::unique_ptr<Module> loadInput(LLVMContext &Ctx, const uint8_t *Data, size_t Size)
+{
+    if (!looksLikeIR(Data, Size))
+        return synthesizeLoops(Ctx, Data, Size);
+
+    SMDiagnostic Err;
+    StringRef Text(reinterpret_cast<const char *>(Data), Size);
+    return parseIR(MemoryBufferRef(Text, "fuzz"), Err, Ctx);
+}
+
+static unsigned countInstructions(Module &M)
+{
+    unsigned n = 0;
+    for (auto &F: M) {
+        for (auto &BB: F) n += BB.size();
+    }
+    return n;
+}
+
+/*Writes the raw input and the module it decodes to into RegressDir*/
+static void saveInput(const uint8_t *Data, size_t Size, const char *kind)
+{
+    StringRef Bytes(reinterpret_cast<const char *>(Data), Size);
+    SmallString<128> Dir(RegressDir);
+    if (Dir.empty()) {
+        sys::path::system_temp_directory(true, Dir);
+        sys::path::append(Dir, "p3-fuzz-slow");
+    }
+    std::string Stem = (Dir + "/" + kind + "-" + utohexstr(hash_value(Bytes))).str();
+    sys::fs::create_directories(Dir);
+
+    std::error_code EC;
+    raw_fd_ostream Raw(Stem + ".bin", EC, sys::fs::OF_None);
+    if (!EC) Raw << Bytes;
+
+    LLVMContext Ctx;
+    std::unique_ptr<Module> M = loadInput(Ctx, Data, Size);
+    raw_fd_ostream IR(Stem + ".ll", EC, sys::fs::OF_Text);
+    if (!EC && M) M->print(IR, nullptr);
+
+    errs() << "p3-fuzz: saved " << kind << " input " << Stem << "\n";
+}
+
+/*Saves the current input and exits if one LICM run exceeds TimeBudget, which
+  catches inputs on which the engine does not terminate*/
+class Watchdog {
+    std::mutex Lock;
+    std::condition_variable Done;
+    bool finished = false;
+    std::thread Thread;
+
+public:
+    Watchdog(const uint8_t *Data, size_t Size) {
+        Thread = std::thread([this, Data, Size] {
+            std::unique_lock<std::mutex> L(Lock);
+            if (!Done.wait_for(L, std::chrono::milliseconds(TimeBudget), [this] { return finished; })) {
+                saveInput(Data, Size, "timeout");
+                _exit(1);
+            }
+        });
+    }
+    ~Watchdog() {
+        {
+            std::lock_guard<std::mutex> L(Lock);
+            finished = true;
+        }
+        Done.notify_one();
+        Thread.join();
+    }
+};
+
+static unsigned nRuns = 0;
+static unsigned nSlow = 0;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+{
+    LLVMContext Ctx;
+    std::unique_ptr<Module> M = loadInput(Ctx, Data, Size);
+    if (!M || verifyModule(*M)) return 0;
+
+    unsigned nInst = countInstructions(*M);
+    if (nInst == 0 || nInst > MaxInstructions) return 0;
+
+    long long ns;
+    {
+        Watchdog W(Data, Size);
+        auto Start = std::chrono::steady_clock::now();
+        LoopInvariantCodeMotion(*M);
+        ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Start).count();
+    }
+
+    nRuns++;
+    if (ns / nInst > MaxNsPerInst) {
+        nSlow++;
+        saveInput(Data, Size, "slow");
+    }
+    return 0;
+}
+
+#ifdef P3_LIBFUZZER
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    std::vector<const char *> Args = {(*argv)[0]};
+    bool ours = false;
+    for (int i = 1; i < *argc; i++) {
+        if (ours) Args.push_back((*argv)[i]);
+        ours |= StringRef((*argv)[i]) == "-ignore_remaining_args=1";
+    }
+    cl::ParseCommandLineOptions(Args.size(), Args.data(), "LICM compile-time fuzzer\n");
+    return 0;
+}
+#else
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "LICM compile-time fuzzer\n");
+
+    if (!Inputs.empty()) {
+        for (auto &Name: Inputs) {
+            auto Buf = MemoryBuffer::getFile(Name);
+            if (!Buf) {
+                errs() << Name << ": " << Buf.getError().message() << "\n";
+                return 1;
+            }
+            StringRef Bytes = (*Buf)->getBuffer();
+            LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(Bytes.data()), Bytes.size());
+        }
+    } else {
+        std::mt19937 Rand(Seed);
+        std::vector<uint8_t> Bytes(256);
+        for (unsigned r = 0; r < Runs; r++) {
+            for (auto &b: Bytes) b = Rand();
+            LLVMFuzzerTestOneInput(Bytes.data(), Bytes.size());
+        }
+    }
+
+    outs() << "p3-fuzz: " << nRuns << " inputs, " << nSlow << " over budget\n";
+    return 0;
+}
+#endif
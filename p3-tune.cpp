@@ -0,0 +1,292 @@
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+
+/*Autotuner for the p3 cost-model thresholds. Every sample is a point in the
+  parameter space below; p3 optimizes each corpus program with it and lli
+  runs the result, keeping the fastest of -repeat runs. Samples whose
+  programs print something different from the untuned p3 output are
+  rejected as miscompiles. The fastest sample is timed again on its own,
+  as the untuned run was, and written as a p3 -config file if it beats the
+  untuned p3.*/
+
+using namespace llvm;
+
+static cl::list<std::string>
+        Corpus(cl::Positional, cl::OneOrMore, cl::desc("<bitcode[:stdin file[:arg,arg...]]>..."));
+
+static cl::opt<std::string>
+        OutputConfig("o",
+                     cl::desc("Tuned configuration file to write."),
+                     cl::init("p3.cfg"));
+
+static cl::opt<unsigned>
+        Samples("samples",
+                cl::desc("Number of random configurations to evaluate."),
+                cl::init(32));
+
+static cl::opt<unsigned>
+        Repeat("repeat",
+               cl::desc("Runs per program and configuration; the fastest one counts."),
+               cl::init(3));
+
+static cl::opt<unsigned>
+        Jobs("j",
+             cl::desc("Samples evaluated in parallel (0 = one per core)."),
+             cl::init(0));
+
+static cl::opt<unsigned>
+        Timeout("timeout",
+                cl::desc("Seconds before a p3 or lli run counts as failed."),
+                cl::init(60));
+
+static cl::opt<unsigned>
+        Seed("seed",
+             cl::desc("Seed for the random configurations."),
+             cl::init(1));
+
+static cl::opt<std::string>
+        Mask("mask",
+             cl::desc("Regex for output that may differ between runs, e.g. timings; ignored when comparing."),
+             cl::init(""));
+
+static cl::opt<std::string>
+        P3Path("p3",
+               cl::desc("p3 binary (default: the one next to p3-tune)."),
+               cl::init(""));
+
+static cl::opt<std::string>
+        LLIPath("lli",
+                cl::desc("JIT used to run the optimized programs."),
+                cl::init("lli"));
+
+/*A tunable p3 option and its range. Prefix options are passed as -O2
+  rather than -O=2.*/
+struct Param {
+    const char *Name;
+    bool Prefix;
+    unsigned Min, Max;
+};
+
+/*-O3 forces -rotate and -promote-globals on, which would make those
+  dimensions dead in its samples. O2 with both set is the same tier, so O
+  stops at 2.*/
+static const Param Space[] = {
+    {"O", true, 1, 2},
+    {"rotate", false, 0, 1},
+    {"rotate-max-header", false, 0, 64},
+    {"interchange", false, 0, 1},
+    {"devirtualize", false, 0, 1},
+    {"devirt-threshold", false, 50, 100},
+    {"promote-globals", false, 0, 1},
+    {"distribute", false, 0, 1},
+    {"commoning", false, 0, 1},
+    {"commoning-distance", false, 1, 8},
+    {"peel-first", false, 0, 1},
+    {"peel-budget", false, 0, 256},
+    {"hoist-guards", false, 0, 1},
+    {"inline-loop-calls", false, 0, 1},
+    {"inline-budget", false, 0, 64},
+    {"specialize-calls", false, 0, 1},
+    {"irreducible-cycles", false, 0, 1},
+};
+
+/*One value per Space entry; an empty Config means p3's own defaults*/
+typedef std::vector<unsigned> Config;
+
+struct Program {
+    std::string Bitcode;
+    std::string Stdin;
+    std::vector<std::string> Args;
+    std::string Reference;
+};
+
+static std::vector<Program> Programs;
+
+static std::string optionArg(const Param &P, unsigned Value)
+{
+    return std::string("-") + P.Name + (P.Prefix ? "" : "=") + utostr(Value);
+}
+
+/*Runs Exe with Args, reading stdin from In and writing stdout to Out.
+  Returns true if it exits with 0 and sets Seconds to its wall time.*/
+static bool runProgram(StringRef Exe, const std::vector<std::string> &Args, StringRef In, StringRef Out,
+                       double &Seconds)
+{
+    std::vector<StringRef> Argv = {Exe};
+    for (auto &A: Args) Argv.push_back(A);
+    Optional<StringRef> Redirects[] = {In, Out, StringRef("")};
+
+    auto Start = std::chrono::steady_clock::now();
+    int rc = sys::ExecuteAndWait(Exe, Argv, None, Redirects, Timeout);
+    Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    return rc == 0;
+}
+
+/*Reads a program's output with every match of -mask removed*/
+static std::string readOutput(StringRef Path)
+{
+    auto Buf = MemoryBuffer::getFile(Path);
+    if (!Buf) return std::string();
+    std::string Output = (*Buf)->getBuffer().str();
+    if (Mask.empty()) return Output;
+
+    std::string Masked;
+    Regex R(Mask);
+    SmallVector<StringRef, 1> Match;
+    StringRef Rest = Output;
+    while (R.match(Rest, &Match) && !Match[0].empty()) {
+        size_t At = Match[0].data() - Rest.data();
+        Masked += Rest.substr(0, At).str();
+        Rest = Rest.substr(At + Match[0].size());
+    }
+    return Masked + Rest.str();
+}
+
+/*Optimizes every program with C and times its JIT execution. Returns the
+  summed time, or a negative value if p3 or the program failed or the
+  output differs from the reference. With SetReference the outputs become
+  the reference instead.*/
+static double evaluate(const Config &C, bool SetReference)
+{
+    SmallString<128> Bitcode, Stdout;
+    sys::fs::createTemporaryFile("p3-tune", "bc", Bitcode);
+    sys::fs::createTemporaryFile("p3-tune", "out", Stdout);
+
+    double total = 0;
+    for (auto &P: Programs) {
+        std::vector<std::string> Args = {P.Bitcode, Bitcode.str().str(), "-no"};
+        for (unsigned i = 0; i < C.size(); i++) Args.push_back(optionArg(Space[i], C[i]));
+
+        double seconds, best = -1;
+        if (!runProgram(P3Path, Args, "", "", seconds)) {
+            total = -1;
+            break;
+        }
+        for (unsigned r = 0; r < Repeat; r++) {
+            std::vector<std::string> LLIArgs = {Bitcode.str().str()};
+            LLIArgs.insert(LLIArgs.end(), P.Args.begin(), P.Args.end());
+            if (!runProgram(LLIPath, LLIArgs, P.Stdin, Stdout, seconds)) {
+                best = -1;
+                break;
+            }
+            if (best < 0 || seconds < best) best = seconds;
+        }
+        if (best < 0) {
+            total = -1;
+            break;
+        }
+
+        std::string Output = readOutput(Stdout);
+        if (SetReference) P.Reference = Output;
+        else if (Output != P.Reference) {
+            total = -1;
+            break;
+        }
+        total += best;
+    }
+
+    sys::fs::remove(Bitcode);
+    sys::fs::remove(Bitcode + ".stats");
+    sys::fs::remove(Stdout);
+    return total;
+}
+
+static bool writeConfig(const Config &C, double seconds, double baseline)
+{
+    std::error_code EC;
+    raw_fd_ostream OS(OutputConfig, EC, sys::fs::OF_Text);
+    if (EC) {
+        errs() << OutputConfig << ": " << EC.message() << "\n";
+        return false;
+    }
+    OS << "# p3-tune: " << format("%.6f", seconds) << " s over " << Programs.size()
+       << " programs, untuned " << format("%.6f", baseline) << " s\n";
+    for (unsigned i = 0; i < C.size(); i++)
+        OS << Space[i].Name << "=" << C[i] << "\n";
+    return true;
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "p3 cost-model autotuner\n");
+
+    if (P3Path.empty()) {
+        SmallString<128> Dir(sys::path::parent_path(sys::fs::getMainExecutable(argv[0], (void *)&main)));
+        sys::path::append(Dir, "p3");
+        P3Path = Dir.str().str();
+    }
+    if (auto LLI = sys::findProgramByName(LLIPath)) LLIPath = *LLI;
+
+    for (auto &Entry: Corpus) {
+        SmallVector<StringRef, 3> Fields;
+        StringRef(Entry).split(Fields, ':', 2);
+        Program P;
+        P.Bitcode = Fields[0].str();
+        if (Fields.size() > 1) P.Stdin = Fields[1].str();
+        if (Fields.size() > 2) {
+            SmallVector<StringRef, 4> Args;
+            Fields[2].split(Args, ',', -1, false);
+            for (auto A: Args) P.Args.push_back(A.str());
+        }
+        Programs.push_back(P);
+    }
+
+    double baseline = evaluate(Config(), true);
+    if (baseline < 0) {
+        errs() << "p3-tune: the corpus does not run with the untuned p3\n";
+        return 1;
+    }
+
+    std::mt19937 Rand(Seed);
+    std::vector<Config> Configs(Samples);
+    for (auto &C: Configs) {
+        for (auto &P: Space)
+            C.push_back(std::uniform_int_distribution<unsigned>(P.Min, P.Max)(Rand));
+    }
+
+    std::vector<double> Times(Configs.size());
+    {
+        ThreadPool Pool(hardware_concurrency(Jobs));
+        for (unsigned s = 0; s < Configs.size(); s++)
+            Pool.async([&, s] { Times[s] = evaluate(Configs[s], false); });
+        Pool.wait();
+    }
+
+    int best = -1;
+    for (unsigned s = 0; s < Configs.size(); s++) {
+        outs() << "sample " << s << ":";
+        for (unsigned i = 0; i < array_lengthof(Space); i++) outs() << " " << optionArg(Space[i], Configs[s][i]);
+        if (Times[s] < 0) outs() << " rejected\n";
+        else outs() << " " << format("%.6f", Times[s]) << " s\n";
+        if (Times[s] >= 0 && (best < 0 || Times[s] < Times[best])) best = s;
+    }
+    if (best < 0) {
+        errs() << "p3-tune: no sample ran correctly\n";
+        return 1;
+    }
+
+    /*the samples competed for cores, the untuned run did not*/
+    double alone = evaluate(Configs[best], false);
+    outs() << "best: sample " << best << ", " << format("%.6f", Times[best]) << " s, "
+           << format("%.6f", alone) << " s alone (untuned " << format("%.6f", baseline) << " s)\n";
+    if (alone < 0 || alone >= baseline) {
+        outs() << "no sample beat the untuned p3, " << OutputConfig << " not written\n";
+        return 0;
+    }
+    return writeConfig(Configs[best], alone, baseline) ? 0 : 1;
+}
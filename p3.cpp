@@ -1,439 +1,3218 @@
-#include <fstream>
-#include <memory>
-#include <algorithm>
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-
-#include "llvm-c/Core.h"
-
-#include "llvm/IR/LLVMContext.h"
-#include "llvm/IR/Module.h"
-#include "llvm/IR/Verifier.h"
-#include "llvm/Bitcode/BitcodeWriter.h"
-#include "llvm/Bitcode/BitcodeReader.h"
-#include "llvm/ADT/StringSet.h"
-#include "llvm/ADT/Statistic.h"
-#include "llvm/IRReader/IRReader.h"
-#include "llvm/Support/CommandLine.h"
-#include "llvm/Support/ToolOutputFile.h"
-#include "llvm/Support/FileSystem.h"
-#include "llvm/IR/LegacyPassManager.h"
-#include "llvm/LinkAllPasses.h"
-#include "llvm/Support/ManagedStatic.h"
-#include "llvm/Support/SourceMgr.h"
-#include "llvm/Analysis/InstructionSimplify.h"
-#include "llvm/Analysis/LoopInfo.h"
-
-#include "llvm/Support/GenericDomTree.h"
-#include "llvm/IR/Dominators.h"
-#include "llvm/Transforms/Utils/LoopUtils.h"
-#include "llvm/CodeGen/Passes.h"
-#include "llvm/Pass.h"
-#include "llvm/Analysis/Loads.h"
-#include "llvm/Transforms/Scalar/LICM.h"
-#include "llvm/Analysis/AliasAnalysis.h"
-#include "llvm/Analysis/MemorySSA.h"
-//#include "llvm/PassAnalysisSupport.h"
-#include "llvm/Analysis/MemorySSAUpdater.h"
-
-
-using namespace llvm;
-bool canMoveOutOfLoop(Loop *L, Instruction *I, DominatorTree *DT);
-static void LoopInvariantCodeMotion(Module &M);
-
-static void summarize(Module *M);
-static void print_csv_file(std::string outputfile);
-
-static cl::opt<std::string>
-        InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Required, cl::init("-"));
-
-static cl::opt<std::string>
-        OutputFilename(cl::Positional, cl::desc("<output bitcode>"), cl::Required, cl::init("out.bc"));
-
-static cl::opt<bool>
-        Mem2Reg("mem2reg",
-                cl::desc("Perform memory to register promotion before LICM."),
-                cl::init(false));
-
-static cl::opt<bool>
-        CSE("cse",
-                cl::desc("Perform CSE before LICM."),
-                cl::init(false));
-
-static cl::opt<bool>
-        NoLICM("no-licm",
-              cl::desc("Do not perform LICM optimization."),
-              cl::init(false));
-
-static cl::opt<bool>
-        Verbose("verbose",
-                    cl::desc("Verbose stats."),
-                    cl::init(false));
-
-static cl::opt<bool>
-        NoCheck("no",
-                cl::desc("Do not check for valid IR."),
-                cl::init(false));
-
-int main(int argc, char **argv) {
-    // Parse command line arguments
-    cl::ParseCommandLineOptions(argc, argv, "llvm system compiler\n");
-
-    // Handle creating output files and shutting down properly
-    llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
-    LLVMContext Context;
-
-    // LLVM idiom for constructing output file.
-    std::unique_ptr<ToolOutputFile> Out;
-    std::string ErrorInfo;
-    std::error_code EC;
-    Out.reset(new ToolOutputFile(OutputFilename.c_str(), EC,
-                                 sys::fs::OF_None));
-
-    EnableStatistics();
-
-    // Read in module
-    SMDiagnostic Err;
-    std::unique_ptr<Module> M;
-    M = parseIRFile(InputFilename, Err, Context);
-
-    // If errors, fail
-    if (M.get() == 0)
-    {
-        Err.print(argv[0], errs());
-        return 1;
-    }
-
-    // If requested, do some early optimizations
-    if (Mem2Reg || CSE)
-    {
-        legacy::PassManager Passes;
-	if (Mem2Reg)
-	  Passes.add(createPromoteMemoryToRegisterPass());
-	if (CSE)
-	  Passes.add(createEarlyCSEPass());
-        Passes.run(*M.get());
-    }
-
-    if (!NoLICM) {
-        LoopInvariantCodeMotion(*M.get());
-    }
-
-    // Collect statistics on Module
-    summarize(M.get());
-    print_csv_file(OutputFilename);
-
-    if (Verbose)
-        PrintStatistics(errs());
-
-    // Verify integrity of Module, do this by default
-    if (!NoCheck)
-    {
-        legacy::PassManager Passes;
-        Passes.add(createVerifierPass());
-        Passes.run(*M.get());
-    }
-
-    // Write final bitcode
-    WriteBitcodeToFile(*M.get(), Out->os());
-    Out->keep();
-
-    return 0;
-}
-
-static llvm::Statistic nFunctions = {"", "Functions", "number of functions"};
-static llvm::Statistic nInstructions = {"", "Instructions", "number of instructions"};
-static llvm::Statistic nLoads = {"", "Loads", "number of loads"};
-static llvm::Statistic nStores = {"", "Stores", "number of stores"};
-
-static void summarize(Module *M) {
-    for (auto i = M->begin(); i != M->end(); i++) {
-        if (i->begin() != i->end()) {
-            nFunctions++;
-        }
-
-        for (auto j = i->begin(); j != i->end(); j++) {
-            for (auto k = j->begin(); k != j->end(); k++) {
-                Instruction &I = *k;
-                nInstructions++;
-                if (isa<LoadInst>(&I)) {
-                    nLoads++;
-                } else if (isa<StoreInst>(&I)) {
-                    nStores++;
-                }
-            }
-        }
-    }
-}
-
-static void print_csv_file(std::string outputfile)
-{
-    std::ofstream stats(outputfile + ".stats");
-    auto a = GetStatistics();
-    for (auto p : a) {
-        stats << p.first.str() << "," << p.second << std::endl;
-    }
-    stats.close();
-}
-
-static llvm::Statistic NumLoops = {"", "NumLoops", "number of loops analyzed"};
-static llvm::Statistic NumLoopsWithCall = {"", "NumLoopsWithCall", "number of loops with a call"};
-static llvm::Statistic NumLoopsNoLoads = {"", "NumLoopsNoLoads", "number of loops analyzed without loads"};
-static llvm::Statistic NumLoopsNoStores = {"", "NumLoopsNoStores", "number of loops analyzed without stores"};
-// add other stats
-static llvm::Statistic LICMBasic = {"", "LICMBasic", "basic loop invariant instructions"};
-static llvm::Statistic LICMLoadHoist = {"", "LICMLoadHoist", "loop invariant load instructions"};
-static llvm::Statistic LICMNoPreheader = {"", "LICMNoPreheader", "absence of preheader prevents optimization"};
-
-
-bool instrIsInLoop(Loop *loop, Instruction *instr) {
-    if (loop->contains(instr))
-    {
-        return true;
-    }else
-    {
-        for (auto subLoop : loop->getSubLoops()) {
-            if (instrIsInLoop(subLoop, instr)) return true;
-        }
-
-        return false;
-    }
-
-}
-
-bool hasAStore = false;
-/*This function updates NumLoopsNoLoads stat*/
-static void numStats(Module &M) {
-    bool containsLoad = false;
-
-    /*loop over all the functions in this module M*/
-    for (auto f = M.begin(); f != M.end(); f++) {
-        if (f->empty()) continue;
-
-        LoopInfoBase<BasicBlock, Loop> *LI = new LoopInfoBase<BasicBlock, Loop>();
-        DominatorTreeBase<BasicBlock, false> *DT = new DominatorTreeBase<BasicBlock, false>();
-        DominatorTree mDT(*f);
-
-        DT->recalculate(*f); // dominance for Function, F
-        LI->analyze(*DT); // calculate loop info
-        /*loop over all the Loops present in this function f*/
-        for (auto li: *LI) {
-            if(li == nullptr) continue;
-            containsLoad = false;
-            /*loop over all the blocks present in this Loop li*/
-            for(auto bb:li->blocks()) {
-                if (bb->empty()) continue;
-                /*loop over all the instructions present in this block bb*/
-                for (auto i = bb->begin(); i != bb->end();i++) {
-                    if(i->getOpcode() == Instruction::Load) {
-                        containsLoad = true;
-                        break;
-                    }
-                }
-                if(containsLoad) break;
-            }
-            if (!containsLoad) {
-                NumLoopsNoLoads++;
-            }
-        }
-    }
-}
-
-/*This function performs LICM on the given loop li*/
-bool mLICM(Loop *li, DominatorTree *mDT)
-{
-    bool mRetVal=false;
-    bool isOpt = false;
-    hasAStore = false;
-    static Loop *prevLoop = nullptr;
-
-    /*loop over all blocks in Loop li*/
-    for(auto bb:li->blocks())
-    {
-        if(bb->empty()) continue;
-        /*loop over all instructions in Block bb*/
-        for (auto i = bb->begin(); i != bb->end();)
-        {
-            Instruction *Inst = &*i++;
-            //check if instruction is load or store
-            if (Inst->getOpcode() == Instruction::Load) {
-                if(canMoveOutOfLoop(li, Inst, mDT))
-                {
-                    isOpt = true;
-                    /*Move the loop invariant instruction to preheader*/
-                    Instruction *mClone = Inst->clone();
-                    //mClone->setName(Inst->getName());
-                    mClone->insertBefore(li->getLoopPreheader()->getTerminator());
-                    Inst->replaceAllUsesWith(mClone);
-                    i=Inst->eraseFromParent();
-                    LICMLoadHoist++;
-                    for (auto ui = Inst->user_begin(); ui != Inst->user_end();) {
-                        Instruction *user = cast<Instruction>(*ui++);
-                        if (li->contains(user->getParent())) {
-                            mRetVal=true;
-                            break;
-                        }
-                    }
-                    /*re run LICM for this loop as an invariant instruction is detected*/
-                }
-            } else if (Inst->getOpcode() == Instruction::Store) {
-            } else {
-                bool changed = false;
-                /*check if an instruction is loop invariant and hoist it if possible*/
-                if (li->makeLoopInvariant(Inst, changed, nullptr, nullptr)) {
-                    if(changed) {
-                        LICMBasic++;
-                        //find uses of the instruction in the loop
-                        for (auto ui = Inst->user_begin(); ui != Inst->user_end();) {
-                            Instruction *user = cast<Instruction>(*ui++);
-                            if (li->contains(user->getParent())) {
-                                mRetVal=true;
-                                break;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-    if(prevLoop == nullptr || prevLoop != li) {
-        prevLoop = li;
-        if (isOpt) {
-            if (!hasAStore) {
-                NumLoopsNoStores++;
-            }
-        }
-    }
-    return mRetVal;
-}
-
-static void LoopInvariantCodeMotion(Module &M)
-{
-    /*loop over all the functions in this Module M*/
-    for(auto f = M.begin(); f!=M.end(); f++)
-    {
-        if (f->empty()) continue;
-
-        LoopInfoBase<BasicBlock, Loop> *LI = new LoopInfoBase<BasicBlock, Loop>();
-        DominatorTreeBase<BasicBlock, false> *DT = new DominatorTreeBase<BasicBlock, false>();
-        DominatorTree mDT(*f);
-
-        DT->recalculate(*f); // dominance for Function, F
-        LI->analyze(*DT); // calculate loop info
-
-        /*loop over all the Loops present in this function f*/
-        for (auto li: *LI)
-        {
-            //li is a Loop*, consider each one
-            if(li == nullptr) continue;
-            BasicBlock *Preheader = li->getLoopPreheader();
-            /*Skip this loop if it doesn't have a preheader*/
-            if (Preheader == nullptr)
-            {
-                LICMNoPreheader++;
-                continue;
-            }
-            //subloops
-            int mCntr=0;
-            for(auto subli: li->getSubLoops())
-            {
-                NumLoops++;
-                while(mLICM(subli, &mDT)) {
-                    mCntr++;
-                }
-            }
-            NumLoops++;
-
-            while(mLICM(li, &mDT)) {
-                mCntr++;
-            }
-        }
-    }
-    numStats(M);
-}
-
-/*This function returns true if its safe to hoist the load instruction*/
-bool canMoveOutOfLoop(Loop *L, Instruction *I, DominatorTree *DT) {
-
-    static Loop *prev=nullptr;
-
-    /*Check if Instruction is volatile*/
-    if (I->isVolatile()) return false;
-
-    /*Check if loop contains a call instruction*/
-    for (auto bb: L->blocks()) {
-        if(bb->empty()) continue;
-        for (auto i = bb->begin(); i != bb->end();i++) {
-            Instruction *Inst = &*i;
-            if (Inst->getOpcode() == Instruction::Call) {
-                if(prev == nullptr || prev != L) {
-                    prev = L;
-                    NumLoopsWithCall++;
-                }
-                return false;
-            }
-        }
-    }
-
-    Value *addr = I->getOperand(0);
-
-    /*addr is a GlobalVariable and there are no possible stores to addr in L*/
-    if ((isa<Constant>(addr)) || (isa<AllocaInst>(addr)))
-    {
-
-        //check if the loop has any conflicting store
-        for (auto bb: L->blocks()) {
-            if(bb->empty()) continue;
-            for (auto i = bb->begin(); i != bb->end();i++) {
-                Instruction *Inst = &*i;
-                if (Inst->getOpcode() == Instruction::Store) {
-                    if((!(isa<Constant>(Inst->getOperand(1)))) && (!(isa<AllocaInst>(Inst->getOperand(1))))) {
-                        hasAStore = true;
-                       // return false;
-                    }
-                    if (Inst->getOperand(1) == addr) {
-                        hasAStore = true;
-                        return false;
-                    }
-                }
-            }
-        }
-
-        if (isa<AllocaInst>(addr))
-        {
-            //additional check for alloca
-            //check if addr instruction is in loop
-            if(instrIsInLoop(L, cast<Instruction>(addr))) return false;
-        }
-
-        return true;
-    }
-    /*there are no possible stores to any addr in L && addr is loop invariant && I dominates L’s exit*/
-    else {
-        //check if the loop has a store
-        for (auto bb: L->blocks()) {
-            if(bb->empty()) continue;
-            for (auto i = bb->begin(); i != bb->end();i++) {
-                Instruction *Inst = &*i;
-                if (Inst->getOpcode() == Instruction::Store) {
-                    hasAStore = true;
-                    return false;
-                }
-            }
-        }
-
-        //check in instruction is in loop
-        if(instrIsInLoop(L, cast<Instruction>(addr))) return false;
-
-        //check if the block containing instruction dominates all loop exits
-        for (auto bb: L->blocks()) {
-            if (L->isLoopExiting(bb)) {
-                if (!DT->dominates(I->getParent(), bb)) {
-                    return false;
-                }
-            }
-        }
-        return true;
-    }
-}
+#include <fstream>
+#include <memory>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <zlib.h>
+#ifdef P3_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef P3_HAVE_NUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+#include "llvm-c/Core.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/LinkAllPasses.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Analysis/InstructionSimplify.h"
+#include "llvm/Analysis/LoopInfo.h"
+
+#include "llvm/Support/GenericDomTree.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/CodeGen/Passes.h"
+#include "llvm/Pass.h"
+#include "llvm/Analysis/Loads.h"
+#include "llvm/Transforms/Scalar/LICM.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/MemorySSA.h"
+//#include "llvm/PassAnalysisSupport.h"
+#include "llvm/Analysis/MemorySSAUpdater.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Transforms/Utils/LoopPeel.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+#include "llvm/Transforms/Utils/LoopRotationUtils.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Analysis/BasicAliasAnalysis.h"
+#include "llvm/Analysis/CycleAnalysis.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/Transforms/Utils/CallPromotionUtils.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Support/Format.h"
+
+#include "p3.h"
+
+
+using namespace llvm;
+static void annotateLoops(Module &M);
+
+/*Reasons canMoveOutOfLoop rejects a load, in the order they are checked*/
+enum HoistBlocker { HB_None, HB_Volatile, HB_Call, HB_Store, HB_VariantAddr, HB_Exit };
+static const char *HoistBlockerNames[] = {"", "volatile", "call", "store", "variant-address", "exit"};
+
+enum Compression { CompressAuto, CompressNone, CompressGzip, CompressZstd };
+static HoistBlocker loadHoistBlocker(Loop *L, Instruction *I, DominatorTree *DT, bool &sawStore,
+                                     const SmallPtrSetImpl<Instruction *> *Hoisted = nullptr);
+static bool wouldHoist(Loop *L, Instruction *I, const SmallPtrSetImpl<Instruction *> &Hoisted);
+
+void summarize(Module *M);
+static void print_csv_file(std::string outputfile);
+static void publishCounters();
+static void numaParsePolicy(bool Parsing);
+static std::unique_ptr<Module> readInput(StringRef File, SMDiagnostic &Err, LLVMContext &Ctx);
+static bool writeOutput(Module &M, StringRef File, raw_ostream &OS);
+
+#ifndef P3_NO_MAIN
+static cl::opt<std::string>
+        InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Required, cl::init("-"));
+
+static cl::opt<std::string>
+        OutputFilename(cl::Positional, cl::desc("<output bitcode>"), cl::Required, cl::init("out.bc"));
+#endif
+
+static cl::opt<bool>
+        Mem2Reg("mem2reg",
+                cl::desc("Perform memory to register promotion before LICM."),
+                cl::init(false));
+
+static cl::opt<bool>
+        CSE("cse",
+                cl::desc("Perform CSE before LICM."),
+                cl::init(false));
+
+static cl::opt<bool>
+        NoLICM("no-licm",
+              cl::desc("Do not perform LICM optimization."),
+              cl::init(false));
+
+/*Tiers trading compile time for hoisting power; see README.md for the
+  compile-time envelope of each and the measurements behind -O3. Without -O
+  the engine does basic and load hoisting as it always has. The other
+  pre-LICM stages are opt-in only.*/
+static cl::opt<unsigned>
+        OptLevel("O",
+                 cl::desc("LICM tier: 1 = basic invariant hoisting only, 2 = adds load hoisting and preheader creation, 3 = adds rotation and global promotion."),
+                 cl::Prefix, cl::init(0));
+
+static cl::opt<bool>
+        Rotate("rotate",
+               cl::desc("Rotate loops that exit from the header into guarded do-while form before LICM."),
+               cl::init(false));
+
+static cl::opt<unsigned>
+        RotateMaxHeader("rotate-max-header",
+                        cl::desc("Maximum number of header instructions -rotate duplicates into the guard."),
+                        cl::init(16));
+
+static cl::opt<bool>
+        Interchange("interchange",
+                    cl::desc("Swap perfectly nested loop pairs when that makes more loads invariant in the inner loop or its accesses closer to unit stride."),
+                    cl::init(false));
+
+static cl::opt<bool>
+        InterchangeReport("interchange-report",
+                          cl::desc("Print the invariance and locality of every -interchange candidate before and after the swap."),
+                          cl::init(false));
+
+static cl::opt<bool>
+        Devirtualize("devirtualize",
+                     cl::desc("Hoist invariant vtable and call target loads of indirect calls in loops, and version loops for a dominant profiled target."),
+                     cl::init(false));
+
+static cl::opt<unsigned>
+        DevirtThreshold("devirt-threshold",
+                        cl::desc("Percentage of an indirect call's profiled calls one target needs for -devirtualize to version the loop."),
+                        cl::init(75));
+
+static cl::opt<bool>
+        PromoteGlobals("promote-globals",
+                       cl::desc("Keep globals that a loop nest accesses directly in registers across the nest, loading them once before it and storing them at its exits."),
+                       cl::init(false));
+
+static cl::opt<bool>
+        Distribute("distribute",
+                   cl::desc("Split loops whose stores block an invariant load into a loop with the stores followed by a store-free loop."),
+                   cl::init(false));
+
+static cl::opt<bool>
+        Commoning("commoning",
+                  cl::desc("Carry values that loads and stores at constant distances access in later iterations through phis instead of reloading them."),
+                  cl::init(false));
+
+static cl::opt<unsigned>
+        CommoningDistance("commoning-distance",
+                          cl::desc("Maximum number of iterations -commoning carries a value."),
+                          cl::init(3));
+
+static cl::opt<bool>
+        PeelFirst("peel-first",
+                  cl::desc("Peel the first iteration of loops whose remaining iterations do not store to an invariant load's address."),
+                  cl::init(false));
+
+static cl::opt<unsigned>
+        PeelBudget("peel-budget",
+                   cl::desc("Maximum number of instructions in a loop that -peel-first may peel."),
+                   cl::init(64));
+
+static cl::opt<bool>
+        HoistGuards("hoist-guards",
+                    cl::desc("Hoist loop invariant bounds and overflow checks into the preheader."),
+                    cl::init(false));
+
+static cl::opt<bool>
+        InlineLoopCalls("inline-loop-calls",
+                        cl::desc("Inline small non-recursive callees called inside loops, so their calls stop blocking load hoisting."),
+                        cl::init(false));
+
+static cl::opt<unsigned>
+        InlineBudget("inline-budget",
+                     cl::desc("Maximum callee size in instructions for -inline-loop-calls, before scaling by the loop hotness."),
+                     cl::init(16));
+
+static cl::opt<unsigned>
+        InlineMaxScale("inline-max-scale",
+                       cl::desc("Maximum factor by which hot loops scale -inline-budget."),
+                       cl::init(4));
+
+static cl::opt<bool>
+        SpecializeCalls("specialize-calls",
+                        cl::desc("Clone callees called inside loops for their constant arguments and hoist the setup computed from invariant arguments into the preheader."),
+                        cl::init(false));
+
+static cl::opt<unsigned>
+        SpecializeBudget("specialize-budget",
+                         cl::desc("Maximum callee size in instructions that -specialize-calls clones."),
+                         cl::init(64));
+
+static cl::opt<bool>
+        IrreducibleCycles("irreducible-cycles",
+                          cl::desc("Also hoist out of irreducible cycles whose entries are all entered from one block."),
+                          cl::init(false));
+
+static cl::opt<unsigned>
+        Threads("threads",
+                cl::desc("Number of threads processing the top-level loop nests of a function."),
+                cl::init(1));
+
+static cl::opt<bool>
+        NUMA("numa",
+             cl::desc("With -threads, bind the workers to NUMA nodes and give each the loop nests whose IR is on its node."),
+             cl::init(false));
+
+static cl::opt<int>
+        LICMLimit("licm-limit",
+                  cl::desc("Apply only the first N hoists of LICM (-1 = all), e.g. to bisect a regression."),
+                  cl::init(-1));
+
+static cl::list<std::string>
+        LICMSkip("licm-skip",
+                 cl::desc("Do not apply the LICM hoists with these IDs."),
+                 cl::CommaSeparated);
+
+static cl::opt<bool>
+        PrintHoists("licm-print-hoists",
+                    cl::desc("Print the ID of every LICM hoist applied."),
+                    cl::init(false));
+
+static cl::opt<bool>
+        Annotate("annotate",
+                 cl::desc("Attach loop invariance facts as !p3.licm metadata to the output bitcode."),
+                 cl::init(false));
+
+static cl::opt<bool>
+        DryRun("dry-run",
+               cl::desc("Only report what LICM would do: no transformation, verification or output bitcode. "
+                        "The stages that run before LICM (preheaders, -rotate, -promote-globals, ...) are skipped."),
+               cl::init(false));
+
+static cl::opt<bool>
+        Verbose("verbose",
+                    cl::desc("Verbose stats."),
+                    cl::init(false));
+
+static cl::opt<bool>
+        NoCheck("no",
+                cl::desc("Do not check for valid IR."),
+                cl::init(false));
+
+static cl::opt<bool>
+        InstrumentLoops("instrument-loops",
+                        cl::desc("Count loop entries and iterations in the output; it writes them to -loop-profile-output at exit."),
+                        cl::init(false));
+
+static cl::opt<std::string>
+        LoopProfileOutput("loop-profile-output",
+                          cl::desc("File an -instrument-loops program writes its loop profile to."),
+                          cl::init("p3-loops.prof"));
+
+static cl::opt<std::string>
+        UseLoopProfile("use-loop-profile",
+                       cl::desc("Base LICM decisions on the trip counts in a loop profile written by an -instrument-loops program."),
+                       cl::init(""));
+
+static cl::opt<std::string>
+        ConfigFile("config",
+                   cl::desc("Load option defaults, e.g. tuned by p3-tune, from a file of name=value lines."),
+                   cl::init(""));
+
+static cl::opt<Compression>
+        Compress("compress",
+                 cl::desc("Compress the output bitcode (default: by a .gz or .zst output extension)."),
+                 cl::values(clEnumValN(CompressNone, "none", "uncompressed"),
+                            clEnumValN(CompressGzip, "gzip", "gzip"),
+                            clEnumValN(CompressZstd, "zstd", "zstd, if p3 was built with libzstd")),
+                 cl::init(CompressAuto));
+
+static cl::opt<int>
+        CompressLevel("compress-level",
+                      cl::desc("Compression level of -compress (-1 = the format's default)."),
+                      cl::init(-1));
+
+static cl::opt<unsigned>
+        CompressThreads("compress-threads",
+                        cl::desc("Threads compressing an output larger than -compress-chunk (0 = one per core)."),
+                        cl::init(0));
+
+static cl::opt<unsigned>
+        CompressChunk("compress-chunk",
+                      cl::desc("KiB of bitcode per gzip member when gzip output is compressed by several threads."),
+                      cl::init(1024));
+
+/*Applies the name=value lines of File to every option not given on the
+  command line. Blank lines and lines starting with # are skipped.*/
+static bool loadConfig(StringRef File)
+{
+    auto Buf = MemoryBuffer::getFile(File);
+    if (!Buf) {
+        errs() << File << ": " << Buf.getError().message() << "\n";
+        return false;
+    }
+    auto &Opts = cl::getRegisteredOptions();
+    SmallVector<StringRef, 16> Lines;
+    (*Buf)->getBuffer().split(Lines, '\n');
+    for (auto Line: Lines) {
+        Line = Line.trim();
+        if (Line.empty() || Line.startswith("#")) continue;
+        auto NameValue = Line.split('=');
+        StringRef Name = NameValue.first.trim(), Value = NameValue.second.trim();
+        auto Opt = Opts.find(Name);
+        if (Opt == Opts.end()) {
+            errs() << File << ": unknown option '" << Name << "'\n";
+            return false;
+        }
+        if (Opt->second->getNumOccurrences() == 0 && Opt->second->addOccurrence(0, Name, Value))
+            return false;
+    }
+    return true;
+}
+
+/*A loop profile is "P3LP", a 32-bit record count and one record of three
+  64-bit words per loop: the loop key, its entries and its iterations, all
+  in host byte order. It is the layout of the counter global that
+  -instrument-loops adds.*/
+struct LoopCounts {
+    uint64_t Entries, Iterations;
+};
+static std::map<uint64_t, LoopCounts> LoopProfile;
+
+/*Identifies the loop with preorder index Index in F, as numbered before
+  any p3 transformation*/
+static uint64_t loopKey(Function &F, unsigned Index)
+{
+    return xxHash64((F.getName() + ":" + Twine(Index)).str());
+}
+
+static bool loadLoopProfile(StringRef File)
+{
+    auto Buf = MemoryBuffer::getFile(File);
+    if (!Buf) {
+        errs() << File << ": " << Buf.getError().message() << "\n";
+        return false;
+    }
+    StringRef Data = (*Buf)->getBuffer();
+    using namespace support;
+    if (Data.size() < 8 || !Data.startswith("P3LP") ||
+        Data.size() != 8 + 24 * (uint64_t)endian::read32(Data.data() + 4, native)) {
+        errs() << File << ": not a p3 loop profile\n";
+        return false;
+    }
+    for (const char *R = Data.data() + 8; R != Data.end(); R += 24) {
+        LoopCounts &C = LoopProfile[endian::read64(R, native)];
+        C.Entries += endian::read64(R + 8, native);
+        C.Iterations += endian::read64(R + 16, native);
+    }
+    return true;
+}
+
+/*Compressed bitcode. Input is recognized by its magic number and inflated
+  in memory straight into the bitcode reader. Output is written to memory
+  and compressed before it reaches the file. Several threads compress gzip
+  output as independent members of -compress-chunk KiB, which gzip and p3
+  read back as one stream; zstd splits the work itself.*/
+static bool isGzip(StringRef Data)
+{
+    return Data.size() >= 2 && (uint8_t)Data[0] == 0x1f && (uint8_t)Data[1] == 0x8b;
+}
+
+static bool isZstd(StringRef Data)
+{
+    return Data.size() >= 4 && support::endian::read32le(Data.data()) == 0xFD2FB528;
+}
+
+static bool gunzip(StringRef In, SmallVectorImpl<char> &Out)
+{
+    z_stream Z;
+    memset(&Z, 0, sizeof(Z));
+    if (inflateInit2(&Z, 16 + MAX_WBITS) != Z_OK) return false;
+    Z.next_in = (Bytef *)In.data();
+    Z.avail_in = In.size();
+    size_t Used = 0;
+    int rc;
+    do {
+        if (Out.size() - Used < (1 << 16)) Out.resize(Out.size() * 2 + (1 << 16));
+        Z.next_out = (Bytef *)Out.data() + Used;
+        Z.avail_out = Out.size() - Used;
+        rc = inflate(&Z, Z_NO_FLUSH);
+        Used = Out.size() - Z.avail_out;
+        /*the next gzip member*/
+        if (rc == Z_STREAM_END && Z.avail_in > 0) rc = inflateReset(&Z);
+    } while (rc == Z_OK || (rc == Z_BUF_ERROR && Z.avail_out == 0));
+    inflateEnd(&Z);
+    Out.resize(Used);
+    return rc == Z_STREAM_END;
+}
+
+static bool gzip(StringRef In, std::string &Out)
+{
+    z_stream Z;
+    memset(&Z, 0, sizeof(Z));
+    int Level = CompressLevel < 0 ? Z_DEFAULT_COMPRESSION : (int)CompressLevel;
+    if (deflateInit2(&Z, Level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+    Out.resize(deflateBound(&Z, In.size()));
+    Z.next_in = (Bytef *)In.data();
+    Z.avail_in = In.size();
+    Z.next_out = (Bytef *)&Out[0];
+    Z.avail_out = Out.size();
+    int rc = deflate(&Z, Z_FINISH);
+    Out.resize(Z.total_out);
+    deflateEnd(&Z);
+    return rc == Z_STREAM_END;
+}
+
+#ifdef P3_HAVE_ZSTD
+static bool unzstd(StringRef In, SmallVectorImpl<char> &Out)
+{
+    ZSTD_DStream *D = ZSTD_createDStream();
+    ZSTD_inBuffer Src = {In.data(), In.size(), 0};
+    size_t Used = 0, rc = 1;
+    while (!ZSTD_isError(rc) && (Src.pos < Src.size || rc != 0)) {
+        if (Out.size() - Used < ZSTD_DStreamOutSize()) Out.resize(Out.size() * 2 + ZSTD_DStreamOutSize());
+        ZSTD_outBuffer Dst = {Out.data() + Used, Out.size() - Used, 0};
+        rc = ZSTD_decompressStream(D, &Dst, &Src);
+        Used += Dst.pos;
+        /*truncated*/
+        if (Src.pos == Src.size && Dst.pos == 0 && rc != 0) break;
+    }
+    ZSTD_freeDStream(D);
+    Out.resize(Used);
+    return !ZSTD_isError(rc) && rc == 0;
+}
+
+static bool zstd(StringRef In, unsigned Workers, std::string &Out)
+{
+    ZSTD_CCtx *C = ZSTD_createCCtx();
+    if (CompressLevel >= 0) ZSTD_CCtx_setParameter(C, ZSTD_c_compressionLevel, CompressLevel);
+    /*fails harmlessly if libzstd was built without threads*/
+    if (Workers > 1 && In.size() > CompressChunk * 1024ull) ZSTD_CCtx_setParameter(C, ZSTD_c_nbWorkers, Workers);
+    Out.resize(ZSTD_compressBound(In.size()));
+    size_t rc = ZSTD_compress2(C, &Out[0], Out.size(), In.data(), In.size());
+    ZSTD_freeCCtx(C);
+    if (ZSTD_isError(rc)) return false;
+    Out.resize(rc);
+    return true;
+}
+#endif
+
+/*Parses File, bitcode or textual IR, inflating it first if it is gzip or
+  zstd compressed*/
+static std::unique_ptr<Module> readInput(StringRef File, SMDiagnostic &Err, LLVMContext &Ctx)
+{
+    auto Buf = MemoryBuffer::getFileOrSTDIN(File);
+    if (!Buf) {
+        Err = SMDiagnostic(File, SourceMgr::DK_Error, "Could not open input file: " + Buf.getError().message());
+        return nullptr;
+    }
+    StringRef Data = (*Buf)->getBuffer();
+    if (!isGzip(Data) && !isZstd(Data)) return parseIR((*Buf)->getMemBufferRef(), Err, Ctx);
+
+    SmallVector<char, 0> Plain;
+    bool Inflated = false;
+    if (isGzip(Data)) Inflated = gunzip(Data, Plain);
+#ifdef P3_HAVE_ZSTD
+    else Inflated = unzstd(Data, Plain);
+#else
+    else {
+        Err = SMDiagnostic(File, SourceMgr::DK_Error, "zstd input, but p3 was built without libzstd");
+        return nullptr;
+    }
+#endif
+    if (!Inflated) {
+        Err = SMDiagnostic(File, SourceMgr::DK_Error, "corrupt compressed input");
+        return nullptr;
+    }
+    return parseIR(MemoryBufferRef(StringRef(Plain.data(), Plain.size()), File), Err, Ctx);
+}
+
+/*Writes M as bitcode to OS, compressed as -compress or the extension of
+  File asks*/
+static bool writeOutput(Module &M, StringRef File, raw_ostream &OS)
+{
+    Compression Kind = Compress;
+    if (Kind == CompressAuto)
+        Kind = File.endswith(".gz") ? CompressGzip : File.endswith(".zst") ? CompressZstd : CompressNone;
+    if (Kind == CompressNone) {
+        WriteBitcodeToFile(M, OS);
+        return true;
+    }
+
+    SmallVector<char, 0> Plain;
+    raw_svector_ostream PlainOS(Plain);
+    WriteBitcodeToFile(M, PlainOS);
+    StringRef Data(Plain.data(), Plain.size());
+    unsigned Workers = hardware_concurrency(CompressThreads).compute_thread_count();
+
+    if (Kind == CompressZstd) {
+#ifdef P3_HAVE_ZSTD
+        std::string Packed;
+        if (!zstd(Data, Workers, Packed)) {
+            errs() << File << ": zstd compression failed\n";
+            return false;
+        }
+        OS << Packed;
+        return true;
+#else
+        errs() << File << ": p3 was built without libzstd\n";
+        return false;
+#endif
+    }
+
+    size_t Chunk = std::max(1u, (unsigned)CompressChunk) * 1024ull;
+    std::vector<std::string> Members(1);
+    std::atomic<bool> Failed(false);
+    if (Workers > 1 && Data.size() > Chunk) {
+        Members.resize((Data.size() + Chunk - 1) / Chunk);
+        ThreadPool Pool(hardware_concurrency(Workers));
+        for (size_t m = 0; m < Members.size(); m++)
+            Pool.async([&, m] { if (!gzip(Data.substr(m * Chunk, Chunk), Members[m])) Failed = true; });
+        Pool.wait();
+    } else if (!gzip(Data, Members[0])) Failed = true;
+    if (Failed) {
+        errs() << File << ": gzip compression failed, check -compress-level\n";
+        return false;
+    }
+    for (auto &Member: Members) OS << Member;
+    return true;
+}
+
+/*Replaces the property Prop of L's loop ID that has the same name, or adds
+  it*/
+static void setLoopProperty(Loop *L, MDTuple *Prop)
+{
+    LLVMContext &Ctx = L->getHeader()->getContext();
+    StringRef PropName = cast<MDString>(Prop->getOperand(0))->getString();
+    SmallVector<Metadata *, 4> LoopMDs;
+    LoopMDs.push_back(nullptr);
+    if (MDNode *ID = L->getLoopID()) {
+        for (unsigned op = 1; op < ID->getNumOperands(); op++) {
+            auto *Old = dyn_cast<MDNode>(ID->getOperand(op));
+            auto *Name = Old && Old->getNumOperands() ? dyn_cast<MDString>(Old->getOperand(0)) : nullptr;
+            if (Name == nullptr || Name->getString() != PropName)
+                LoopMDs.push_back(ID->getOperand(op));
+        }
+    }
+    LoopMDs.push_back(Prop);
+    MDNode *NewID = MDNode::getDistinct(Ctx, LoopMDs);
+    NewID->replaceOperandWith(0, NewID);
+    L->setLoopID(NewID);
+}
+
+/*Reads the p3.loop.profile property -use-loop-profile attached to L*/
+static bool loopCounts(Loop *L, LoopCounts &C)
+{
+    MDNode *Prop = findOptionMDForLoop(L, "p3.loop.profile");
+    if (Prop == nullptr || Prop->getNumOperands() != 3) return false;
+    C.Entries = mdconst::extract<ConstantInt>(Prop->getOperand(1))->getZExtValue();
+    C.Iterations = mdconst::extract<ConstantInt>(Prop->getOperand(2))->getZExtValue();
+    return true;
+}
+
+/*Returns true if the loop profile shows that L was never entered*/
+static bool isColdLoop(Loop *L)
+{
+    LoopCounts C;
+    return loopCounts(L, C) && C.Entries == 0;
+}
+
+#ifndef P3_NO_MAIN
+int main(int argc, char **argv) {
+    // Parse command line arguments
+    cl::ParseCommandLineOptions(argc, argv, "llvm system compiler\n");
+    if (!ConfigFile.empty() && !loadConfig(ConfigFile))
+        return 1;
+    if (OptLevel > 3) {
+        errs() << argv[0] << ": -O" << OptLevel << " is not a tier, use -O1, -O2 or -O3\n";
+        return 1;
+    }
+    if (!UseLoopProfile.empty() && !loadLoopProfile(UseLoopProfile))
+        return 1;
+
+    // Handle creating output files and shutting down properly
+    llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
+    LLVMContext Context;
+
+    // LLVM idiom for constructing output file.
+    std::unique_ptr<ToolOutputFile> Out;
+    std::string ErrorInfo;
+    std::error_code EC;
+    if (!DryRun)
+        Out.reset(new ToolOutputFile(OutputFilename.c_str(), EC,
+                                     sys::fs::OF_None));
+
+    EnableStatistics();
+
+    // Read in module
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M;
+    numaParsePolicy(true);
+    M = readInput(InputFilename, Err, Context);
+    numaParsePolicy(false);
+
+    // If errors, fail
+    if (M.get() == 0)
+    {
+        Err.print(argv[0], errs());
+        return 1;
+    }
+
+    // If requested, do some early optimizations
+    if (Mem2Reg || CSE)
+    {
+        legacy::PassManager Passes;
+	if (Mem2Reg)
+	  Passes.add(createPromoteMemoryToRegisterPass());
+	if (CSE)
+	  Passes.add(createEarlyCSEPass());
+        Passes.run(*M.get());
+    }
+
+    if (!NoLICM) {
+        LoopInvariantCodeMotion(*M.get());
+    }
+
+    if (Annotate && !DryRun) {
+        annotateLoops(*M.get());
+    }
+
+    // Collect statistics on Module
+    summarize(M.get());
+    publishCounters();
+    print_csv_file(OutputFilename);
+
+    if (Verbose)
+        PrintStatistics(errs());
+
+    if (DryRun)
+        return 0;
+
+    // Verify integrity of Module, do this by default
+    if (!NoCheck)
+    {
+        legacy::PassManager Passes;
+        Passes.add(createVerifierPass());
+        Passes.run(*M.get());
+    }
+
+    // Write final bitcode
+    if (!writeOutput(*M.get(), OutputFilename, Out->os()))
+        return 1;
+    Out->keep();
+
+    return 0;
+}
+#endif
+
+/*A statistic that threads count without sharing a cache line. Every
+  thread increments its own block of counters; publishCounters adds the
+  blocks up into the llvm::Statistic of the same name once processing is
+  done, so the .stats file and -verbose print what they always did.*/
+class Counter {
+public:
+    Counter(const char *Name, const char *Desc);
+    void operator++(int) { add(1); }
+    void operator+=(uint64_t N) { add(N); }
+
+private:
+    friend void publishCounters();
+    void add(uint64_t N);
+
+    llvm::Statistic Stat;
+    unsigned Index;
+    /*a counter that was never touched is not registered, as with
+      llvm::Statistic*/
+    std::atomic<bool> Used{false};
+};
+
+namespace {
+struct CounterRegistry {
+    std::mutex Lock;
+    std::vector<Counter *> Counters;
+    /*counters in the order they were first touched, the order in which
+      llvm::Statistic registers them*/
+    std::vector<Counter *> Touched;
+    /*counts of the running threads, and of the threads that exited*/
+    std::vector<std::atomic<uint64_t> *> Blocks;
+    std::vector<uint64_t> Retired;
+};
+
+/*The counters of one thread, folded into Retired when the thread exits*/
+struct CounterBlock {
+    std::unique_ptr<std::atomic<uint64_t>[]> Values;
+    unsigned Size;
+    CounterBlock();
+    ~CounterBlock();
+};
+}
+
+static CounterRegistry &counterRegistry()
+{
+    static CounterRegistry R;
+    return R;
+}
+
+CounterBlock::CounterBlock()
+{
+    CounterRegistry &R = counterRegistry();
+    std::lock_guard<std::mutex> Guard(R.Lock);
+    Size = R.Counters.size();
+    Values.reset(new std::atomic<uint64_t>[Size]());
+    R.Blocks.push_back(Values.get());
+}
+
+CounterBlock::~CounterBlock()
+{
+    CounterRegistry &R = counterRegistry();
+    std::lock_guard<std::mutex> Guard(R.Lock);
+    for (unsigned i = 0; i < Size; i++) R.Retired[i] += Values[i].load(std::memory_order_relaxed);
+    R.Blocks.erase(std::find(R.Blocks.begin(), R.Blocks.end(), Values.get()));
+}
+
+Counter::Counter(const char *Name, const char *Desc) : Stat{"", Name, Desc}
+{
+    CounterRegistry &R = counterRegistry();
+    std::lock_guard<std::mutex> Guard(R.Lock);
+    Index = R.Counters.size();
+    R.Counters.push_back(this);
+    R.Retired.push_back(0);
+}
+
+void Counter::add(uint64_t N)
+{
+    if (N == 0) return;
+    static thread_local CounterBlock Block;
+    /*only this thread writes the block, so no locked instruction is needed*/
+    std::atomic<uint64_t> &V = Block.Values[Index];
+    V.store(V.load(std::memory_order_relaxed) + N, std::memory_order_relaxed);
+    if (!Used.load(std::memory_order_relaxed) && !Used.exchange(true)) {
+        CounterRegistry &R = counterRegistry();
+        std::lock_guard<std::mutex> Guard(R.Lock);
+        R.Touched.push_back(this);
+    }
+}
+
+/*Adds up the counts of all threads into the llvm::Statistic registry*/
+static void publishCounters()
+{
+    CounterRegistry &R = counterRegistry();
+    std::lock_guard<std::mutex> Guard(R.Lock);
+    for (auto C: R.Touched) {
+        uint64_t Total = R.Retired[C->Index];
+        for (auto B: R.Blocks) Total += B[C->Index].load(std::memory_order_relaxed);
+        R.Retired[C->Index] = 0;
+        for (auto B: R.Blocks) B[C->Index].store(0, std::memory_order_relaxed);
+        C->Stat += Total;
+    }
+}
+
+static Counter nFunctions("Functions", "number of functions");
+static Counter nInstructions("Instructions", "number of instructions");
+static Counter nLoads("Loads", "number of loads");
+static Counter nStores("Stores", "number of stores");
+
+void summarize(Module *M) {
+    for (auto i = M->begin(); i != M->end(); i++) {
+        if (i->begin() != i->end()) {
+            nFunctions++;
+        }
+
+        for (auto j = i->begin(); j != i->end(); j++) {
+            for (auto k = j->begin(); k != j->end(); k++) {
+                Instruction &I = *k;
+                nInstructions++;
+                if (isa<LoadInst>(&I)) {
+                    nLoads++;
+                } else if (isa<StoreInst>(&I)) {
+                    nStores++;
+                }
+            }
+        }
+    }
+}
+
+static void print_csv_file(std::string outputfile)
+{
+    std::ofstream stats(outputfile + ".stats");
+    auto a = GetStatistics();
+    for (auto p : a) {
+        stats << p.first.str() << "," << p.second << std::endl;
+    }
+    stats.close();
+}
+
+static Counter NumLoops("NumLoops", "number of loops analyzed");
+static Counter NumLoopsWithCall("NumLoopsWithCall", "number of loops with a call");
+static Counter NumLoopsNoLoads("NumLoopsNoLoads", "number of loops analyzed without loads");
+static Counter NumLoopsNoStores("NumLoopsNoStores", "number of loops analyzed without stores");
+// add other stats
+static Counter LICMBasic("LICMBasic", "basic loop invariant instructions");
+static Counter LICMLoadHoist("LICMLoadHoist", "loop invariant load instructions");
+static Counter LICMNoPreheader("LICMNoPreheader", "absence of preheader prevents optimization");
+static Counter LICMPreheaderCreated("LICMPreheaderCreated", "preheaders created for LICM");
+static Counter LICMRotated("LICMRotated", "loops rotated into bottom-test form");
+static Counter LICMDistributed("LICMDistributed", "loops distributed to separate stores from invariant loads");
+static Counter LICMCommoned("LICMCommoned", "loads replaced by values of earlier iterations");
+static Counter LICMPeeled("LICMPeeled", "loops peeled to expose invariant loads");
+static Counter LICMAnnotated("LICMAnnotated", "instructions annotated with loop invariance facts");
+static Counter LICMGuardHoist("LICMGuardHoist", "loop invariant checks hoisted into the preheader");
+static Counter LICMCycleHoist("LICMCycleHoist", "instructions hoisted out of irreducible cycles");
+static Counter LICMInstrumented("LICMInstrumented", "loops instrumented with trip counters");
+static Counter LICMColdSkipped("LICMColdSkipped", "loops skipped as never entered in the loop profile");
+static Counter LICMInlined("LICMInlined", "calls inside loops inlined before LICM");
+static Counter LICMSpecialized("LICMSpecialized", "calls inside loops specialized for constant arguments");
+static Counter LICMSetupHoisted("LICMSetupHoisted", "callee setup instructions hoisted into the preheader");
+static Counter LICMVTableHoisted("LICMVTableHoisted", "invariant vtable and call target loads hoisted");
+static Counter LICMCallTargetHoisted("LICMCallTargetHoisted", "call target computations hoisted besides their loads");
+static Counter LICMDevirtualized("LICMDevirtualized", "loops versioned for the dominant target of an indirect call");
+static Counter LICMGlobalPromoted("LICMGlobalPromoted", "globals kept in registers across a loop nest");
+static Counter LICMInterchanged("LICMInterchanged", "loop nests interchanged for invariance or locality");
+static Counter LICMNumaRemote("LICMNumaRemote", "loop nests processed by a worker on another NUMA node");
+
+
+bool instrIsInLoop(Loop *loop, Instruction *instr) {
+    if (loop->contains(instr))
+    {
+        return true;
+    }else
+    {
+        for (auto subLoop : loop->getSubLoops()) {
+            if (instrIsInLoop(subLoop, instr)) return true;
+        }
+
+        return false;
+    }
+
+}
+
+/*A call or invoke blocks load hoisting unless it only reads memory. A call
+  that may throw is an implicit exit in the middle of a block, so it also has
+  to be nounwind; an invoke's unwind edge is an ordinary loop exit instead.*/
+static bool callBlocksLoadHoist(CallBase *CB) {
+    if (isa<DbgInfoIntrinsic>(CB)) return false;
+    if (!CB->onlyReadsMemory()) return true;
+    if (isa<InvokeInst>(CB)) return false;
+    return !CB->doesNotThrow();
+}
+
+/*Like Loop::isLoopExiting, but treats the unwind edge of an invoke as a loop
+  exit only if the invoke can actually throw*/
+static bool isLoopExitingBlock(Loop *L, BasicBlock *BB) {
+    Instruction *T = BB->getTerminator();
+    if (auto *II = dyn_cast<InvokeInst>(T)) {
+        if (!L->contains(II->getNormalDest())) return true;
+        if (II->doesNotThrow()) return false;
+        return !L->contains(II->getUnwindDest());
+    }
+    return L->isLoopExiting(BB);
+}
+
+/*With -threads, every top-level loop nest of a function is processed by one
+  worker. Analysis only reads the nest's own blocks and the function's
+  dominator tree, whose DFS numbers are computed before the workers start
+  so that dominates() never updates them; LICM does not change the CFG, so
+  the tree stays valid and read-only. Cloning, moving and erasing
+  instructions also edits the use lists of shared values (globals,
+  constants, values defined before the nest) and the context's metadata, so
+  all IR mutation goes through this lock.*/
+static std::mutex IRMutex;
+
+/*With -licm-limit, -licm-skip or -licm-print-hoists every hoist of mLICM
+  is decided on its own and has an ID, <function>#<n>, where n numbers the
+  instructions of the function as LICM finds it. Nests are then processed
+  serially so the hoist order is reproducible.*/
+static DenseMap<Instruction *, unsigned> HoistOrdinals;
+static unsigned HoistsApplied = 0;
+
+static bool selectingHoists()
+{
+    return LICMLimit >= 0 || !LICMSkip.empty() || PrintHoists;
+}
+
+static void numberHoistCandidates(Function &F)
+{
+    HoistOrdinals.clear();
+    unsigned n = 0;
+    for (auto &bb: F) {
+        for (auto &Inst: bb) HoistOrdinals[&Inst] = n++;
+    }
+}
+
+/*Returns true if the hoist of I passes -licm-limit and -licm-skip*/
+static bool allowHoist(Instruction *I, const char *Kind)
+{
+    if (!selectingHoists()) return true;
+    std::string ID = (I->getFunction()->getName() + "#" + Twine(HoistOrdinals.lookup(I))).str();
+    if (is_contained(LICMSkip, ID)) return false;
+    if (LICMLimit >= 0 && HoistsApplied >= (unsigned)LICMLimit) return false;
+    HoistsApplied++;
+    if (PrintHoists) errs() << "hoist " << ID << " " << Kind << "\n";
+    return true;
+}
+
+/*The dominator tree and loop info of the function being processed, one set
+  per thread. reset() recomputes them in place for the next function: the
+  loops live in LoopInfo's bump allocator, which releaseMemory() resets in
+  one step, and the maps keep their buckets. Batch runs therefore neither
+  leak nor fragment the heap.*/
+struct FunctionScratch {
+    DominatorTree DT;
+    LoopInfoBase<BasicBlock, Loop> LI;
+
+    void reset(Function &F) {
+        LI.releaseMemory();
+        DT.recalculate(F);
+        LI.analyze(DT);
+    }
+    void release() {
+        LI.releaseMemory();
+        DT.reset();
+    }
+};
+
+static FunctionScratch &functionScratch()
+{
+    static thread_local FunctionScratch Scratch;
+    return Scratch;
+}
+
+/*The last loop counted towards NumLoopsNoStores and NumLoopsWithCall on this
+  thread. FunctionScratch hands the next function's loops the same addresses,
+  so a loop is only identified together with its function.*/
+struct CountedLoop {
+    const Function *F = nullptr;
+    const Loop *L = nullptr;
+
+    bool firstVisit(Loop *li) {
+        const Function *Fn = li->getHeader()->getParent();
+        if (F == Fn && L == li) return false;
+        F = Fn;
+        L = li;
+        return true;
+    }
+};
+
+thread_local bool hasAStore = false;
+/*This function updates NumLoopsNoLoads stat*/
+void numStats(Module &M) {
+    bool containsLoad = false;
+
+    /*loop over all the functions in this module M*/
+    for (auto f = M.begin(); f != M.end(); f++) {
+        if (f->empty()) continue;
+
+        FunctionScratch &S = functionScratch();
+        S.reset(*f); // dominance and loop info for Function, F
+        LoopInfoBase<BasicBlock, Loop> *LI = &S.LI;
+        /*loop over all the Loops present in this function f*/
+        for (auto li: *LI) {
+            if(li == nullptr) continue;
+            containsLoad = false;
+            /*loop over all the blocks present in this Loop li*/
+            for(auto bb:li->blocks()) {
+                if (bb->empty()) continue;
+                /*loop over all the instructions present in this block bb*/
+                for (auto i = bb->begin(); i != bb->end();i++) {
+                    if(i->getOpcode() == Instruction::Load) {
+                        containsLoad = true;
+                        break;
+                    }
+                }
+                if(containsLoad) break;
+            }
+            if (!containsLoad) {
+                NumLoopsNoLoads++;
+            }
+        }
+    }
+}
+
+/*This function performs LICM on the given loop li*/
+bool mLICM(Loop *li, DominatorTree *mDT)
+{
+    bool mRetVal=false;
+    bool isOpt = false;
+    hasAStore = false;
+    static thread_local CountedLoop prevLoop;
+
+    /*loop over all blocks in Loop li*/
+    for(auto bb:li->blocks())
+    {
+        if(bb->empty()) continue;
+        /*loop over all instructions in Block bb*/
+        for (auto i = bb->begin(); i != bb->end();)
+        {
+            Instruction *Inst = &*i++;
+            //check if instruction is load or store
+            if (Inst->getOpcode() == Instruction::Load) {
+                if(OptLevel != 1 && canMoveOutOfLoop(li, Inst, mDT) && allowHoist(Inst, "load"))
+                {
+                    std::lock_guard<std::mutex> Lock(IRMutex);
+                    isOpt = true;
+                    /*Move the loop invariant instruction to preheader*/
+                    Instruction *mClone = Inst->clone();
+                    //mClone->setName(Inst->getName());
+                    mClone->insertBefore(li->getLoopPreheader()->getTerminator());
+                    if (selectingHoists()) {
+                        /*the clone keeps the hoist ID for its hoist out of an outer loop*/
+                        HoistOrdinals[mClone] = HoistOrdinals.lookup(Inst);
+                        HoistOrdinals.erase(Inst);
+                    }
+                    Inst->replaceAllUsesWith(mClone);
+                    i=Inst->eraseFromParent();
+                    LICMLoadHoist++;
+                    for (auto ui = mClone->user_begin(); ui != mClone->user_end();) {
+                        Instruction *user = cast<Instruction>(*ui++);
+                        if (li->contains(user->getParent())) {
+                            mRetVal=true;
+                            break;
+                        }
+                    }
+                    /*re run LICM for this loop as an invariant instruction is detected*/
+                }
+            } else if (Inst->getOpcode() == Instruction::Store) {
+            } else {
+                bool changed = false;
+                /*one hoist at a time: makeLoopInvariant would also hoist the operands*/
+                if (selectingHoists() && (!wouldHoist(li, Inst, SmallPtrSet<Instruction *, 1>()) ||
+                                          !allowHoist(Inst, "basic")))
+                    continue;
+                std::lock_guard<std::mutex> Lock(IRMutex);
+                /*check if an instruction is loop invariant and hoist it if possible*/
+                if (li->makeLoopInvariant(Inst, changed, nullptr, nullptr)) {
+                    if(changed) {
+                        LICMBasic++;
+                        //find uses of the instruction in the loop
+                        for (auto ui = Inst->user_begin(); ui != Inst->user_end();) {
+                            Instruction *user = cast<Instruction>(*ui++);
+                            if (li->contains(user->getParent())) {
+                                mRetVal=true;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if(prevLoop.firstVisit(li)) {
+        if (isOpt) {
+            if (!hasAStore) {
+                NumLoopsNoStores++;
+            }
+        }
+    }
+    return mRetVal;
+}
+
+/*Runs LICM on the top-level loop li and its immediate subloops. Only the
+  blocks of li and its preheader are changed, so disjoint nests of the same
+  function can be processed concurrently.*/
+static void licmLoopNest(Loop *li, DominatorTree *mDT)
+{
+    BasicBlock *Preheader = li->getLoopPreheader();
+    /*Skip this loop if it doesn't have a preheader*/
+    if (Preheader == nullptr)
+    {
+        LICMNoPreheader++;
+        return;
+    }
+    //subloops
+    int mCntr=0;
+    for(auto subli: li->getSubLoops())
+    {
+        NumLoops++;
+        if (isColdLoop(subli))
+        {
+            LICMColdSkipped++;
+            continue;
+        }
+        while(mLICM(subli, mDT)) {
+            mCntr++;
+        }
+    }
+    NumLoops++;
+    if (isColdLoop(li))
+    {
+        LICMColdSkipped++;
+        return;
+    }
+
+    while(mLICM(li, mDT)) {
+        mCntr++;
+    }
+}
+
+/*Returns the successor of Br that is taken only on the first iteration of L,
+  or nullptr if no successor has that property. Succ is "first-iteration only"
+  when the compare selecting it is known to go the other way on every
+  iteration that follows the first one. If PostInc is false the check is done
+  on the loop as it is after peeling, where the induction already starts one
+  step further.*/
+static BasicBlock *firstIterationSuccessor(Loop *L, BranchInst *Br, ScalarEvolution &SE, bool PostInc)
+{
+    if (!Br->isConditional()) return nullptr;
+    auto *Cmp = dyn_cast<ICmpInst>(Br->getCondition());
+    if (Cmp == nullptr) return nullptr;
+
+    ICmpInst::Predicate Pred = Cmp->getPredicate();
+    const SCEV *LHS = SE.getSCEV(Cmp->getOperand(0));
+    const SCEV *RHS = SE.getSCEV(Cmp->getOperand(1));
+    if (!isa<SCEVAddRecExpr>(LHS)) {
+        std::swap(LHS, RHS);
+        Pred = ICmpInst::getSwappedPredicate(Pred);
+    }
+    auto *AR = dyn_cast<SCEVAddRecExpr>(LHS);
+    if (AR == nullptr || AR->getLoop() != L || !SE.isLoopInvariant(RHS, L)) return nullptr;
+    if (PostInc) AR = AR->getPostIncExpr(SE);
+
+    /*the true edge is first-iteration only if the compare is false afterwards*/
+    if (SE.isKnownOnEveryIteration(ICmpInst::getInversePredicate(Pred), AR, RHS))
+        return Br->getSuccessor(0);
+    if (SE.isKnownOnEveryIteration(Pred, AR, RHS))
+        return Br->getSuccessor(1);
+    return nullptr;
+}
+
+/*Returns the branch guarding BB with an edge that is only taken on the first
+  iteration of L, or nullptr if BB may execute on later iterations too*/
+static BranchInst *firstIterationGuard(Loop *L, BasicBlock *BB, DominatorTree &DT, ScalarEvolution &SE)
+{
+    for (auto DomNode = DT.getNode(BB); DomNode != nullptr; DomNode = DomNode->getIDom()) {
+        BasicBlock *Succ = DomNode->getBlock();
+        if (!L->contains(Succ) || Succ == L->getHeader()) return nullptr;
+        BasicBlock *Pred = Succ->getSinglePredecessor();
+        if (Pred == nullptr) continue;
+        auto *Br = dyn_cast<BranchInst>(Pred->getTerminator());
+        if (Br != nullptr && firstIterationSuccessor(L, Br, SE, true) == Succ) return Br;
+    }
+    return nullptr;
+}
+
+/*Returns true if peeling the first iteration of L leaves a loop in which the
+  load I is no longer blocked by a store, i.e. every store that conflicts
+  with I in canMoveOutOfLoop is only reached on the first iteration*/
+static bool peelExposesLoad(Loop *L, LoadInst *I, DominatorTree &DT, ScalarEvolution &SE,
+                            SmallPtrSetImpl<BranchInst *> &Guards)
+{
+    if (I->isVolatile()) return false;
+    Value *addr = I->getPointerOperand();
+    if (auto *AddrInst = dyn_cast<Instruction>(addr))
+        if (instrIsInLoop(L, AddrInst)) return false;
+    bool fixedAddr = isa<Constant>(addr) || isa<AllocaInst>(addr);
+
+    bool hasConflict = false;
+    for (auto bb: L->blocks()) {
+        for (auto &Inst: *bb) {
+            if (isa<CallBase>(&Inst) && callBlocksLoadHoist(cast<CallBase>(&Inst))) return false;
+            auto *SI = dyn_cast<StoreInst>(&Inst);
+            if (SI == nullptr) continue;
+            if (fixedAddr && SI->getPointerOperand() != addr) continue;
+            BranchInst *Guard = firstIterationGuard(L, bb, DT, SE);
+            if (Guard == nullptr) return false;
+            Guards.insert(Guard);
+            hasConflict = true;
+        }
+    }
+    return hasConflict;
+}
+
+/*Rewrites the guards of a freshly peeled loop to always take their
+  later-iteration edge, which makes the first-iteration-only blocks dead*/
+static void foldFirstIterationGuards(Loop *L, ScalarEvolution &SE, SmallPtrSetImpl<BranchInst *> &Guards)
+{
+    SE.forgetLoop(L);
+    for (auto Br: Guards) {
+        BasicBlock *Dead = firstIterationSuccessor(L, Br, SE, false);
+        if (Dead == nullptr) continue;
+        BasicBlock *Live = Br->getSuccessor(Dead == Br->getSuccessor(0) ? 1 : 0);
+        Value *Cond = Br->getCondition();
+        Dead->removePredecessor(Br->getParent());
+        BranchInst::Create(Live, Br);
+        Br->eraseFromParent();
+        RecursivelyDeleteTriviallyDeadInstructions(Cond);
+    }
+}
+
+/*Peels the first iteration of loops in F when that makes a load invariant in
+  the remaining loop, so LICM can hoist it afterwards*/
+static bool peelFirstIterations(Function &F, DominatorTree &DT, LoopInfo &LI)
+{
+    TargetLibraryInfoImpl TLII(Triple(F.getParent()->getTargetTriple()));
+    TargetLibraryInfo TLI(TLII);
+    AssumptionCache AC(F);
+    ScalarEvolution SE(F, TLI, AC, DT, LI);
+    bool changed = false;
+
+    for (auto L: LI.getLoopsInPreorder()) {
+        unsigned size = 0;
+        for (auto bb: L->blocks()) size += bb->size();
+        if (size > PeelBudget) continue;
+        /*peeling a loop that runs less than twice per entry only grows it*/
+        LoopCounts C;
+        if (loopCounts(L, C) && C.Iterations < 2 * C.Entries) continue;
+
+        SmallPtrSet<BranchInst *, 4> Guards;
+        bool exposed = false;
+        for (auto bb: L->blocks()) {
+            for (auto &Inst: *bb) {
+                auto *LoadI = dyn_cast<LoadInst>(&Inst);
+                if (LoadI != nullptr && peelExposesLoad(L, LoadI, DT, SE, Guards)) exposed = true;
+            }
+        }
+        if (!exposed) continue;
+
+        /*peelLoop rewires exit values through LCSSA phis*/
+        simplifyLoop(L, &DT, &LI, &SE, &AC, nullptr, false);
+        formLCSSARecursively(*L, DT, &LI, &SE);
+        if (!canPeel(L)) continue;
+        if (!peelLoop(L, 1, &LI, &SE, DT, &AC, true)) continue;
+        foldFirstIterationGuards(L, SE, Guards);
+        LICMPeeled++;
+        changed = true;
+    }
+    if (changed) {
+        /*the folded guards left dead blocks behind in the loops*/
+        removeUnreachableBlocks(F);
+        DT.recalculate(F);
+        LI.releaseMemory();
+        LI.analyze(DT);
+    }
+    return changed;
+}
+
+/*Returns true if Fail, entered from the loop block From, starts a failure
+  path, i.e. a chain of blocks ending in unreachable (a trap, abort or
+  sanitizer report) that does not use values computed in L. That includes
+  the values Fail's phis receive from From, which the hoisted guard cannot
+  provide.*/
+static bool isFailurePath(Loop *L, BasicBlock *From, BasicBlock *Fail)
+{
+    for (auto &Phi: Fail->phis()) {
+        auto *OpI = dyn_cast<Instruction>(Phi.getIncomingValueForBlock(From));
+        if (OpI != nullptr && L->contains(OpI)) return false;
+    }
+    BasicBlock *BB = Fail;
+    for (unsigned depth = 0; BB != nullptr && depth < 4; depth++) {
+        for (auto &Inst: *BB) {
+            if (isa<PHINode>(&Inst)) continue;
+            for (auto &Op: Inst.operands()) {
+                auto *OpI = dyn_cast<Instruction>(Op);
+                if (OpI != nullptr && L->contains(OpI)) return false;
+            }
+        }
+        if (isa<UnreachableInst>(BB->getTerminator())) return true;
+        BB = BB->getSingleSuccessor();
+    }
+    return false;
+}
+
+/*Hoists the operand tree of a guard condition in front of InsertPt. Loads
+  are only hoisted when canMoveOutOfLoop allows it. The moves count towards
+  LICMGuardHoist with their guard, not towards the LICM statistics.*/
+static bool makeGuardInvariant(Loop *L, Value *V, DominatorTree &DT, Instruction *InsertPt)
+{
+    auto *I = dyn_cast<Instruction>(V);
+    if (I == nullptr || !L->contains(I)) return true;
+
+    if (auto *LoadI = dyn_cast<LoadInst>(I)) {
+        if (!makeGuardInvariant(L, LoadI->getPointerOperand(), DT, InsertPt)) return false;
+        if (!canMoveOutOfLoop(L, LoadI, &DT)) return false;
+        LoadI->moveBefore(InsertPt);
+        return true;
+    }
+    if (isa<PHINode>(I) || I->isEHPad() || I->mayReadFromMemory() || !isSafeToSpeculativelyExecute(I))
+        return false;
+    for (auto &Op: I->operands()) {
+        if (!makeGuardInvariant(L, Op, DT, InsertPt)) return false;
+    }
+    I->moveBefore(InsertPt);
+    return true;
+}
+
+/*Moves the branch Br, which leaves L for the failure path Fail when its
+  invariant condition fails, into a new block in front of the preheader*/
+static void hoistGuard(Loop *L, BranchInst *Br, BasicBlock *Fail, DominatorTree &DT, LoopInfo &LI)
+{
+    BasicBlock *BB = Br->getParent();
+    BasicBlock *Guard = L->getLoopPreheader();
+    BasicBlock *Cont = Br->getSuccessor(Br->getSuccessor(0) == Fail ? 1 : 0);
+    BasicBlock *Preheader = SplitBlock(Guard, Guard->getTerminator(), &DT, &LI);
+
+    Instruction *OldT = Guard->getTerminator();
+    if (Br->getSuccessor(0) == Fail)
+        BranchInst::Create(Fail, Preheader, Br->getCondition(), OldT);
+    else
+        BranchInst::Create(Preheader, Fail, Br->getCondition(), OldT);
+    OldT->eraseFromParent();
+
+    for (auto &Phi: Fail->phis())
+        Phi.addIncoming(Phi.getIncomingValueForBlock(BB), Guard);
+    Fail->removePredecessor(BB);
+    BranchInst::Create(Cont, Br);
+    Br->eraseFromParent();
+    DT.recalculate(*BB->getParent());
+}
+
+/*Hoists invariant checks that leave the loop for a failure path. A check is
+  only hoisted if, starting at the header, it is reached on every iteration
+  before anything with a side effect, so failing early in the preheader is
+  indistinguishable from failing in the first iteration.*/
+static bool hoistInvariantGuards(Function &F, DominatorTree &DT, LoopInfo &LI)
+{
+    bool changed = false;
+
+    for (auto L: LI.getLoopsInPreorder()) {
+        if (L->getLoopPreheader() == nullptr) continue;
+
+        SmallPtrSet<BasicBlock *, 8> Visited;
+        BasicBlock *BB = L->getHeader();
+        while (BB != nullptr && L->contains(BB) && Visited.insert(BB).second) {
+            bool sideEffects = false;
+            for (auto &Inst: *BB) sideEffects |= Inst.mayHaveSideEffects();
+            auto *Br = dyn_cast<BranchInst>(BB->getTerminator());
+            if (sideEffects || Br == nullptr) break;
+            if (Br->isUnconditional()) {
+                BB = Br->getSuccessor(0);
+                continue;
+            }
+
+            BasicBlock *Fail = nullptr;
+            for (auto Succ: Br->successors()) {
+                if (!L->contains(Succ)) Fail = Succ;
+            }
+            if (Fail == nullptr || Br->getSuccessor(0) == Br->getSuccessor(1)) break;
+            if (!isFailurePath(L, BB, Fail)) break;
+            if (!makeGuardInvariant(L, Br->getCondition(), DT, L->getLoopPreheader()->getTerminator()))
+                break;
+
+            BB = Br->getSuccessor(Br->getSuccessor(0) == Fail ? 1 : 0);
+            hoistGuard(L, Br, Fail, DT, LI);
+            LICMGuardHoist++;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/*Gives every loop in F that has none a preheader, so LICM does not have to
+  skip it*/
+static void insertPreheaders(Function &F, DominatorTree &DT, LoopInfo &LI)
+{
+    for (auto L: LI.getLoopsInPreorder()) {
+        if (L->getLoopPreheader() != nullptr) continue;
+        if (InsertPreheaderForLoop(L, &DT, &LI, nullptr, false) != nullptr)
+            LICMPreheaderCreated++;
+    }
+}
+
+/*Rotates loops that exit from the header into guarded bottom-test form, so
+  the body dominates the latch exit and canMoveOutOfLoop's exit dominance
+  check can succeed for its loads. Inner loops go first.*/
+static void rotateLoops(Function &F, DominatorTree &DT, LoopInfo &LI)
+{
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    TargetTransformInfo TTI(DL);
+    AssumptionCache AC(F);
+    SimplifyQuery SQ(DL, nullptr, &DT, &AC);
+
+    auto Loops = LI.getLoopsInPreorder();
+    for (auto L: reverse(Loops)) {
+        BasicBlock *Latch = L->getLoopLatch();
+        if (!L->isLoopExiting(L->getHeader()) || (Latch != nullptr && L->isLoopExiting(Latch))) continue;
+        simplifyLoop(L, &DT, &LI, nullptr, &AC, nullptr, false);
+        if (LoopRotation(L, &LI, &TTI, &AC, &DT, nullptr, nullptr, SQ, false, RotateMaxHeader, true))
+            LICMRotated++;
+    }
+}
+
+/*Returns true if V is a load of a vtable pointer that !invariant.group
+  marks as unchanging for the object it is loaded from*/
+static bool isInvariantVTableLoad(Value *V)
+{
+    auto *LoadI = dyn_cast<LoadInst>(V);
+    return LoadI != nullptr && LoadI->isSimple() && LoadI->hasMetadata(LLVMContext::MD_invariant_group);
+}
+
+/*Returns true if the operand tree of an indirect call target can leave L.
+  Besides speculatable instructions that takes a vtable pointer load marked
+  !invariant.group, and a slot load that is marked !invariant.load or reads
+  at a constant offset from such a vtable, whose contents cannot change.*/
+static bool canHoistCallTarget(Loop *L, Value *V)
+{
+    auto *I = dyn_cast<Instruction>(V);
+    if (I == nullptr || !L->contains(I)) return true;
+
+    if (auto *LoadI = dyn_cast<LoadInst>(I)) {
+        Value *Addr = LoadI->getPointerOperand();
+        bool invariant = isInvariantVTableLoad(LoadI) ||
+                         (LoadI->isSimple() && LoadI->hasMetadata(LLVMContext::MD_invariant_load));
+        if (!invariant && LoadI->isSimple()) {
+            APInt Offset(LoadI->getModule()->getDataLayout().getIndexTypeSizeInBits(Addr->getType()), 0);
+            invariant = isInvariantVTableLoad(
+                    Addr->stripAndAccumulateInBoundsConstantOffsets(LoadI->getModule()->getDataLayout(), Offset));
+        }
+        return invariant && canHoistCallTarget(L, Addr);
+    }
+    if (isa<PHINode>(I) || I->isEHPad() || I->mayReadFromMemory() || !isSafeToSpeculativelyExecute(I))
+        return false;
+    for (auto &Op: I->operands()) {
+        if (!canHoistCallTarget(L, Op)) return false;
+    }
+    return true;
+}
+
+/*Moves the operand tree of an indirect call target, which
+  canHoistCallTarget accepted, in front of InsertPt. The caller makes sure
+  the call runs whenever the loop is entered.*/
+static void hoistCallTarget(Loop *L, Value *V, Instruction *InsertPt)
+{
+    auto *I = dyn_cast<Instruction>(V);
+    if (I == nullptr || !L->contains(I)) return;
+
+    for (auto &Op: I->operands()) hoistCallTarget(L, Op, InsertPt);
+    I->moveBefore(InsertPt);
+    if (isa<LoadInst>(I)) LICMVTableHoisted++;
+    else LICMCallTargetHoisted++;
+}
+
+/*Returns the function in M that takes at least -devirt-threshold percent
+  of the calls in the indirect call profile of CB, or nullptr*/
+static Function *dominantCallTarget(CallBase *CB, uint64_t &Count, uint64_t &Total)
+{
+    MDNode *Prof = CB->getMetadata(LLVMContext::MD_prof);
+    if (Prof == nullptr || Prof->getNumOperands() < 5) return nullptr;
+    auto *Tag = dyn_cast<MDString>(Prof->getOperand(0));
+    auto *Kind = mdconst::dyn_extract<ConstantInt>(Prof->getOperand(1));
+    auto *Sum = mdconst::dyn_extract<ConstantInt>(Prof->getOperand(2));
+    if (Tag == nullptr || Tag->getString() != "VP" || Kind == nullptr || Kind->getZExtValue() != IPVK_IndirectCallTarget ||
+        Sum == nullptr || Sum->isZero())
+        return nullptr;
+
+    uint64_t Hash = 0;
+    Count = 0;
+    Total = Sum->getZExtValue();
+    for (unsigned op = 3; op + 1 < Prof->getNumOperands(); op += 2) {
+        auto *H = mdconst::dyn_extract<ConstantInt>(Prof->getOperand(op));
+        auto *C = mdconst::dyn_extract<ConstantInt>(Prof->getOperand(op + 1));
+        if (H != nullptr && C != nullptr && C->getZExtValue() > Count) {
+            Hash = H->getZExtValue();
+            Count = C->getZExtValue();
+        }
+    }
+    /*Count * 100 < Total * DevirtThreshold, which may not fit 64 bits*/
+    if ((APInt(128, Count) * 100).ult(APInt(128, Total) * DevirtThreshold)) return nullptr;
+    for (auto &F: *CB->getModule()) {
+        if (Function::getGUID(F.getName()) == Hash || Function::getGUID(getPGOFuncName(F)) == Hash)
+            return isLegalToPromote(*CB, &F) ? &F : nullptr;
+    }
+    return nullptr;
+}
+
+/*Versions the innermost loop L on its invariant indirect call target: a
+  copy of L in which CB calls Target directly runs when the target is
+  Target, so LICM sees the callee's attributes instead of an unknown call*/
+static void versionForTarget(Loop *L, CallBase *CB, Function *Target, uint64_t Count, uint64_t Total,
+                             DominatorTree &DT, LoopInfo &LI)
+{
+    formLCSSA(*L, DT, &LI, nullptr);
+    BasicBlock *Check = L->getLoopPreheader();
+    BasicBlock *Preheader = SplitBlock(Check, Check->getTerminator(), &DT, &LI);
+    ValueToValueMapTy VMap;
+    SmallVector<BasicBlock *, 8> Blocks;
+    Loop *Direct = cloneLoopWithPreheader(Preheader, Check, L, VMap, ".devirt", &LI, &DT, Blocks);
+    remapInstructionsInBlocks(Blocks, VMap);
+
+    /*the exits are now also reached from the copy*/
+    SmallVector<Loop::Edge, 4> Exits;
+    L->getExitEdges(Exits);
+    for (auto &Exit: Exits) {
+        for (auto &Phi: Exit.second->phis()) {
+            Value *V = Phi.getIncomingValueForBlock(Exit.first);
+            Value *Copy = VMap.lookup(V);
+            Phi.addIncoming(Copy ? Copy : V, cast<BasicBlock>(VMap[Exit.first]));
+        }
+    }
+
+    IRBuilder<> B(Check->getTerminator());
+    Value *Callee = CB->getCalledOperand();
+    uint64_t Scale = Total / UINT32_MAX + 1;
+    Value *IsTarget = B.CreateICmpEQ(Callee, B.CreatePointerCast(Target, Callee->getType()), "devirt");
+    B.CreateCondBr(IsTarget, Direct->getLoopPreheader(), Preheader,
+                   MDBuilder(CB->getContext()).createBranchWeights(Count / Scale, (Total - Count) / Scale));
+    Check->getTerminator()->eraseFromParent();
+
+    auto *DirectCall = cast<CallBase>(VMap[CB]);
+    DirectCall->setMetadata(LLVMContext::MD_prof, nullptr);
+    promoteCall(*DirectCall, Target);
+    DT.recalculate(*Check->getParent());
+}
+
+/*Hoists the vtable and function pointer loads of indirect calls out of
+  innermost loops, and versions a loop for the dominant profiled target of
+  such a call. Only calls that run whenever the loop is entered are
+  considered, so the hoisted loads cannot fault where the loop would not
+  have.*/
+static bool devirtualizeLoops(Function &F, DominatorTree &DT, LoopInfo &LI)
+{
+    bool changed = false;
+
+    auto Loops = LI.getLoopsInPreorder();
+    for (auto L: Loops) {
+        if (!L->isInnermost() || L->getLoopPreheader() == nullptr || isColdLoop(L)) continue;
+
+        CallBase *Versioned = nullptr;
+        Function *Target = nullptr;
+        uint64_t Count = 0, Total = 0;
+        for (auto bb: L->blocks()) {
+            bool always = true;
+            for (auto Exiting: L->blocks()) {
+                if (isLoopExitingBlock(L, Exiting) && !DT.dominates(bb, Exiting)) always = false;
+            }
+            if (!always) continue;
+            for (auto &Inst: *bb) {
+                auto *CB = dyn_cast<CallBase>(&Inst);
+                if (CB == nullptr || !CB->isIndirectCall()) continue;
+                if (!canHoistCallTarget(L, CB->getCalledOperand())) continue;
+                hoistCallTarget(L, CB->getCalledOperand(), L->getLoopPreheader()->getTerminator());
+                changed = true;
+                if (Versioned == nullptr && (Target = dominantCallTarget(CB, Count, Total)) != nullptr)
+                    Versioned = CB;
+            }
+        }
+        if (Versioned == nullptr) continue;
+        versionForTarget(L, Versioned, Target, Count, Total, DT, LI);
+        LICMDevirtualized++;
+    }
+    return changed;
+}
+
+/*Returns true if the address of G is used for more than the simple loads
+  and stores that access it directly*/
+static bool isAddressTaken(GlobalVariable *G)
+{
+    for (auto U: G->users()) {
+        if (auto *LoadI = dyn_cast<LoadInst>(U)) {
+            if (LoadI->isSimple()) continue;
+        } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+            if (SI->isSimple() && SI->getValueOperand() != G) continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+/*Returns true if an access through Ptr may touch G. Without AA, i.e. in
+  functions other than the one being optimized, only the underlying object
+  tells. A G that is Escaped may be reached through any pointer that is not
+  based on another object.*/
+static bool mayAccessGlobal(Value *Ptr, GlobalVariable *G, bool Escaped, AAResults *AA)
+{
+    const Value *Obj = getUnderlyingObject(Ptr);
+    if (Obj == G) return true;
+    if (isa<AllocaInst>(Obj) || isa<GlobalVariable>(Obj) || isa<Function>(Obj) || !Escaped) return false;
+    return AA == nullptr ||
+           !AA->isNoAlias(MemoryLocation::getBeforeOrAfter(Ptr), MemoryLocation::getBeforeOrAfter(G));
+}
+
+static bool functionMayAccessGlobal(Function &F, GlobalVariable *G, bool Escaped, const TargetLibraryInfo &TLI,
+                                    DenseMap<Function *, bool> &Memo, unsigned Depth);
+
+/*Returns true if the call CB may read or write G. Library functions only
+  touch program memory through their pointer arguments, unless they get a
+  callback; functions defined in the module are checked body by body.*/
+static bool callMayAccessGlobal(CallBase *CB, GlobalVariable *G, bool Escaped, AAResults *AA,
+                                const TargetLibraryInfo &TLI, DenseMap<Function *, bool> &Memo, unsigned Depth)
+{
+    if (isa<DbgInfoIntrinsic>(CB) || CB->doesNotAccessMemory() || CB->onlyAccessesInaccessibleMemory()) return false;
+    for (auto &Arg: CB->args()) {
+        auto *PT = dyn_cast<PointerType>(Arg->getType());
+        if (PT == nullptr) continue;
+        if (isa<Function>(Arg->stripPointerCasts()) || (!PT->isOpaque() && PT->getPointerElementType()->isFunctionTy()))
+            return true;
+        if (mayAccessGlobal(Arg, G, Escaped, AA)) return true;
+    }
+    if (CB->onlyAccessesArgMemory()) return false;
+    Function *Callee = CB->getCalledFunction();
+    if (Callee == nullptr) return true;
+    LibFunc LF;
+    if (Callee->isDeclaration()) return !TLI.getLibFunc(*Callee, LF) || !TLI.has(LF);
+    return functionMayAccessGlobal(*Callee, G, Escaped, TLI, Memo, Depth + 1);
+}
+
+/*Returns true if F or a function it calls may read or write G. Recursion
+  and call chains deeper than 8 count as accessing it.*/
+static bool functionMayAccessGlobal(Function &F, GlobalVariable *G, bool Escaped, const TargetLibraryInfo &TLI,
+                                    DenseMap<Function *, bool> &Memo, unsigned Depth)
+{
+    auto Known = Memo.find(&F);
+    if (Known != Memo.end()) return Known->second;
+    if (Depth > 8) return true;
+    Memo[&F] = true;
+    bool may = false;
+    for (auto &I: instructions(F)) {
+        if (auto *CB = dyn_cast<CallBase>(&I)) may = callMayAccessGlobal(CB, G, Escaped, nullptr, TLI, Memo, Depth);
+        else if (I.mayReadOrWriteMemory())
+            may = getLoadStorePointerOperand(&I) == nullptr ||
+                  mayAccessGlobal(getLoadStorePointerOperand(&I), G, Escaped, nullptr);
+        if (may) break;
+    }
+    Memo[&F] = may;
+    return may;
+}
+
+/*Returns true if CB may leave the loop other than through its exits, by
+  throwing, exiting the program or not returning at all*/
+static bool callMayNotReturn(CallBase *CB, const TargetLibraryInfo &TLI)
+{
+    if (isa<DbgInfoIntrinsic>(CB)) return false;
+    if (CB->mayThrow() || CB->doesNotReturn()) return true;
+    LibFunc LF;
+    Function *Callee = CB->getCalledFunction();
+    bool library = Callee != nullptr && Callee->isDeclaration() && TLI.getLibFunc(*Callee, LF) && TLI.has(LF);
+    return !CB->willReturn() && !library;
+}
+
+/*Rewrites the accesses of a promoted global to SSA values and stores the
+  last value at every exit*/
+class GlobalPromoter : public LoadAndStorePromoter {
+    GlobalVariable *G;
+    SSAUpdater &SSA;
+    ArrayRef<BasicBlock *> Exits;
+    Align Alignment;
+
+public:
+    GlobalPromoter(ArrayRef<const Instruction *> Insts, SSAUpdater &S, GlobalVariable *G,
+                   ArrayRef<BasicBlock *> Exits, Align Alignment)
+            : LoadAndStorePromoter(Insts, S, G->getName()), G(G), SSA(S), Exits(Exits), Alignment(Alignment) {}
+
+    void doExtraRewritesBeforeFinalDeletion() override
+    {
+        for (auto Exit: Exits)
+            new StoreInst(SSA.GetValueInMiddleOfBlock(Exit), G, false, Alignment, &*Exit->getFirstInsertionPt());
+    }
+};
+
+/*Promotes G in L if nothing in L but its own direct accesses may touch it.
+  With stores, one of them has to run on every iteration, so the stores at
+  the exits only repeat a store that happened anyway, and no call may leave
+  L without passing an exit.*/
+static bool promoteGlobal(Loop *L, GlobalVariable *G, DominatorTree &DT, LoopInfo &LI, AAResults &AA,
+                          const TargetLibraryInfo &TLI)
+{
+    bool Escaped = !G->hasLocalLinkage() || isAddressTaken(G);
+    DenseMap<Function *, bool> Memo;
+    SmallVector<Instruction *, 8> Uses;
+    bool stores = false, leaves = false, always = false;
+    Align Alignment = G->getPointerAlignment(G->getParent()->getDataLayout());
+
+    for (auto bb: L->blocks()) {
+        for (auto &I: *bb) {
+            Value *Ptr = getLoadStorePointerOperand(&I);
+            if (Ptr != nullptr && Ptr->stripPointerCasts() == G) {
+                auto *SI = dyn_cast<StoreInst>(&I);
+                Type *Ty = SI != nullptr ? SI->getValueOperand()->getType() : I.getType();
+                if (Ty != G->getValueType() || (SI != nullptr ? !SI->isSimple() : !cast<LoadInst>(&I)->isSimple()))
+                    return false;
+                Uses.push_back(&I);
+                Alignment = std::min(Alignment, getLoadStoreAlignment(&I));
+                if (SI == nullptr) continue;
+                stores = true;
+                bool dominatesExits = true;
+                for (auto Exiting: L->blocks()) {
+                    if (isLoopExitingBlock(L, Exiting) && !DT.dominates(bb, Exiting)) dominatesExits = false;
+                }
+                always |= dominatesExits;
+            } else if (auto *CB = dyn_cast<CallBase>(&I)) {
+                if (callMayAccessGlobal(CB, G, Escaped, &AA, TLI, Memo, 0)) return false;
+                leaves |= callMayNotReturn(CB, TLI);
+            } else if (I.mayReadOrWriteMemory() && (Ptr == nullptr || mayAccessGlobal(Ptr, G, Escaped, &AA))) {
+                return false;
+            }
+        }
+    }
+    if (Uses.empty()) return false;
+
+    SmallVector<BasicBlock *, 4> Exits;
+    if (stores) {
+        if (leaves || !always) return false;
+        if (!L->hasDedicatedExits()) formDedicatedExitBlocks(L, &DT, &LI, nullptr, false);
+        L->getUniqueExitBlocks(Exits);
+        if (!L->hasDedicatedExits() || any_of(Exits, [](BasicBlock *BB) { return BB->isEHPad(); })) return false;
+    }
+
+    SmallVector<const Instruction *, 8> ConstUses(Uses.begin(), Uses.end());
+    SSAUpdater SSA;
+    GlobalPromoter Promoter(ConstUses, SSA, G, Exits, Alignment);
+    BasicBlock *Preheader = L->getLoopPreheader();
+    auto *Initial = new LoadInst(G->getValueType(), G, G->getName() + ".promoted", false, Alignment,
+                                 Preheader->getTerminator());
+    SSA.AddAvailableValue(Preheader, Initial);
+    Promoter.run(Uses);
+    if (Initial->use_empty()) Initial->eraseFromParent();
+    return true;
+}
+
+/*Keeps the globals that loops of F access directly in registers across the
+  outermost loop in which nothing else may touch them, which also lifts the
+  store that kept canMoveOutOfLoop from hoisting their loads*/
+static bool promoteGlobals(Function &F, DominatorTree &DT, LoopInfo &LI)
+{
+    TargetLibraryInfoImpl TLII(Triple(F.getParent()->getTargetTriple()));
+    TargetLibraryInfo TLI(TLII);
+    AssumptionCache AC(F);
+    BasicAAResult BAR(F.getParent()->getDataLayout(), F, TLI, AC, &DT);
+    AAResults AA(TLI);
+    AA.addAAResult(BAR);
+    bool changed = false;
+
+    /*outer loops first: a global promoted there is gone from the inner ones*/
+    for (auto L: LI.getLoopsInPreorder()) {
+        if (L->getLoopPreheader() == nullptr || isColdLoop(L)) continue;
+        SetVector<GlobalVariable *> Globals;
+        for (auto bb: L->blocks()) {
+            for (auto &I: *bb) {
+                Value *Ptr = getLoadStorePointerOperand(&I);
+                auto *G = Ptr != nullptr ? dyn_cast<GlobalVariable>(Ptr->stripPointerCasts()) : nullptr;
+                if (G != nullptr && !G->isConstant() && !G->hasExternalWeakLinkage() &&
+                    G->getValueType()->isSingleValueType())
+                    Globals.insert(G);
+            }
+        }
+        for (auto G: Globals) {
+            if (!promoteGlobal(L, G, DT, LI, AA, TLI)) continue;
+            LICMGlobalPromoted++;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/*The induction of a loop of an -interchange candidate: its header phi and
+  the instructions of the latch that compute the next value and the exit
+  condition*/
+struct LoopControl {
+    PHINode *IV = nullptr;
+    BranchInst *Br = nullptr;
+    SmallVector<Instruction *, 4> Insts;
+};
+
+/*Collects the control of L, whose latch Latch is its only exiting block.
+  The latch instructions it uses must only depend on the induction and on
+  values from outside Nest, and only serve the induction and the branch.*/
+static bool loopControl(Loop *L, Loop *Nest, BasicBlock *Latch, LoopControl &C)
+{
+    BasicBlock *Header = L->getHeader();
+    C.Br = dyn_cast<BranchInst>(Latch->getTerminator());
+    if (C.Br == nullptr || !C.Br->isConditional() || L->getExitingBlock() != Latch || L->getLoopLatch() != Latch)
+        return false;
+    auto Phis = Header->phis();
+    if (Phis.empty() || std::next(Phis.begin()) != Phis.end()) return false;
+    C.IV = &*Phis.begin();
+    if (C.IV->getNumIncomingValues() != 2 || !Nest->isLoopInvariant(C.IV->getIncomingValueForBlock(L->getLoopPreheader())))
+        return false;
+
+    SmallPtrSet<Instruction *, 8> Slice;
+    SmallVector<Instruction *, 8> Work;
+    for (auto V: {C.IV->getIncomingValueForBlock(Latch), C.Br->getCondition()}) {
+        if (auto *I = dyn_cast<Instruction>(V)) Work.push_back(I);
+    }
+    while (!Work.empty()) {
+        Instruction *I = Work.pop_back_val();
+        if (I == C.IV || !Slice.insert(I).second) continue;
+        if (I->getParent() != Latch || I->mayHaveSideEffects() || I->mayReadFromMemory() || isa<PHINode>(I))
+            return false;
+        for (auto &Op: I->operands()) {
+            auto *OpI = dyn_cast<Instruction>(Op);
+            if (OpI != nullptr && Nest->contains(OpI)) Work.push_back(OpI);
+        }
+    }
+    for (auto &I: *Latch) {
+        if (!Slice.count(&I)) continue;
+        for (auto U: I.users()) {
+            if (U != C.IV && U != C.Br && !Slice.count(cast<Instruction>(U))) return false;
+        }
+        C.Insts.push_back(&I);
+    }
+    return true;
+}
+
+/*Cache lines an access through Ptr touches per iteration of L: none if it
+  is invariant, the fraction of a 64-byte line its stride covers otherwise,
+  and a whole line if the stride is unknown*/
+static double accessCost(Value *Ptr, Loop *L, ScalarEvolution &SE)
+{
+    const SCEV *S = SE.getSCEV(Ptr);
+    while (true) {
+        if (SE.isLoopInvariant(S, L)) return 0;
+        auto *AR = dyn_cast<SCEVAddRecExpr>(S);
+        if (AR == nullptr || !AR->isAffine()) return 1;
+        if (AR->getLoop() != L) {
+            S = AR->getStart();
+            continue;
+        }
+        auto *Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+        if (Step == nullptr) return 1;
+        return std::min<uint64_t>(Step->getAPInt().abs().getLimitedValue(), 64) / 64.0;
+    }
+}
+
+/*Returns false if a dependence between the accesses of the nest Outer
+  would be reversed by swapping Outer and Inner, i.e. one carried by Outer
+  that goes backwards in Inner*/
+static bool canInterchange(Loop *Outer, Loop *Inner, ArrayRef<Instruction *> Accesses, DependenceInfo &DI)
+{
+    unsigned OuterLevel = Outer->getLoopDepth(), InnerLevel = Inner->getLoopDepth();
+    for (unsigned a = 0; a < Accesses.size(); a++) {
+        for (unsigned b = a; b < Accesses.size(); b++) {
+            if (!isa<StoreInst>(Accesses[a]) && !isa<StoreInst>(Accesses[b])) continue;
+            auto D = DI.depends(Accesses[a], Accesses[b], true);
+            if (D == nullptr) continue;
+            if (D->isConfused() || D->getLevels() < InnerLevel) return false;
+            if ((D->getDirection(OuterLevel) & Dependence::DVEntry::LT) &&
+                (D->getDirection(InnerLevel) & Dependence::DVEntry::GT))
+                return false;
+            if ((D->getDirection(OuterLevel) & Dependence::DVEntry::GT) &&
+                (D->getDirection(InnerLevel) & Dependence::DVEntry::LT))
+                return false;
+        }
+    }
+    return true;
+}
+
+/*Moves the control From of one loop into Latch, the latch of the other
+  loop, whose header Header the induction moves to. Header's loop is
+  entered from Entry.*/
+static void moveControl(LoopControl &From, BasicBlock *Header, BasicBlock *Entry, BasicBlock *Latch,
+                        BranchInst *OldBr)
+{
+    BasicBlock *OldHeader = From.IV->getParent();
+    Value *Start = From.IV->getIncomingValue(From.IV->getIncomingBlock(0) == From.Br->getParent() ? 1 : 0);
+    Value *Next = From.IV->getIncomingValueForBlock(From.Br->getParent());
+    From.IV->moveBefore(&*Header->begin());
+    From.IV->setIncomingBlock(0, Entry);
+    From.IV->setIncomingValue(0, Start);
+    From.IV->setIncomingBlock(1, Latch);
+    From.IV->setIncomingValue(1, Next);
+    for (auto I: From.Insts) I->moveBefore(OldBr);
+
+    /*keep the branch polarity and the latch's own loop metadata*/
+    bool ContinueFirst = From.Br->getSuccessor(0) == OldHeader;
+    BasicBlock *Exit = OldBr->getSuccessor(OldBr->getSuccessor(0) == Header ? 1 : 0);
+    auto *Br = BranchInst::Create(ContinueFirst ? Header : Exit, ContinueFirst ? Exit : Header,
+                                  From.Br->getCondition(), OldBr);
+    Br->setMetadata(LLVMContext::MD_prof, From.Br->getMetadata(LLVMContext::MD_prof));
+    Br->setMetadata(LLVMContext::MD_loop, OldBr->getMetadata(LLVMContext::MD_loop));
+}
+
+/*Swaps the perfectly nested, rectangular loops Outer and Inner when the
+  accesses of the nest touch fewer cache lines per inner iteration
+  afterwards, which counts loads that become invariant in the inner loop,
+  and so hoistable by LICM, as touching none. The swap exchanges the
+  inductions and exit conditions of the two loops; the blocks stay.*/
+static bool interchangeNest(Loop *Outer, ScalarEvolution &SE, DependenceInfo &DI)
+{
+    if (Outer->getSubLoops().size() != 1) return false;
+    Loop *Inner = Outer->getSubLoops()[0];
+    BasicBlock *OuterHeader = Outer->getHeader(), *OuterLatch = Outer->getLoopLatch();
+    BasicBlock *InnerHeader = Inner->getHeader(), *InnerLatch = Inner->getLoopLatch();
+    if (!Inner->isInnermost() || Outer->getLoopPreheader() == nullptr || OuterLatch == nullptr ||
+        InnerLatch == nullptr || Inner->getLoopPreheader() != OuterHeader ||
+        Outer->getNumBlocks() != Inner->getNumBlocks() + 2 || OuterLatch->getSinglePredecessor() != InnerLatch ||
+        OuterHeader->getTerminator()->getNumSuccessors() != 1 || OuterHeader->getFirstNonPHI() != OuterHeader->getTerminator())
+        return false;
+
+    LoopControl OuterC, InnerC;
+    if (!loopControl(Outer, Outer, OuterLatch, OuterC) || !loopControl(Inner, Outer, InnerLatch, InnerC) ||
+        OuterLatch->size() != OuterC.Insts.size() + 1)
+        return false;
+
+    SmallVector<Instruction *, 16> Accesses;
+    double before = 0, after = 0;
+    unsigned invariantBefore = 0, invariantAfter = 0;
+    for (auto bb: Inner->blocks()) {
+        for (auto &I: *bb) {
+            for (auto U: I.users()) {
+                if (!Outer->contains(cast<Instruction>(U))) return false;
+            }
+            if (isa<DbgInfoIntrinsic>(&I)) continue;
+            if (isa<CallBase>(&I)) return false;
+            if (!I.mayReadOrWriteMemory()) continue;
+            Value *Ptr = getLoadStorePointerOperand(&I);
+            if (Ptr == nullptr || !(isa<LoadInst>(&I) ? cast<LoadInst>(&I)->isSimple() : cast<StoreInst>(&I)->isSimple()))
+                return false;
+            Accesses.push_back(&I);
+            double costBefore = accessCost(Ptr, Inner, SE), costAfter = accessCost(Ptr, Outer, SE);
+            before += costBefore;
+            after += costAfter;
+            if (isa<LoadInst>(&I)) {
+                invariantBefore += costBefore == 0;
+                invariantAfter += costAfter == 0;
+            }
+        }
+    }
+    OuterC.Insts.push_back(OuterC.IV);
+    for (auto I: OuterC.Insts) {
+        for (auto U: I->users()) {
+            if (!Outer->contains(cast<Instruction>(U))) return false;
+        }
+    }
+    OuterC.Insts.pop_back();
+
+    bool profitable = after < before || (after == before && invariantAfter > invariantBefore);
+    bool legal = profitable && canInterchange(Outer, Inner, Accesses, DI);
+    if (InterchangeReport) {
+        outs() << "interchange " << OuterHeader->getParent()->getName() << " ";
+        OuterHeader->printAsOperand(outs(), false);
+        outs() << "/";
+        InnerHeader->printAsOperand(outs(), false);
+        outs() << ": inner-invariant loads " << invariantBefore << " -> " << invariantAfter << ", cache lines per inner iteration "
+               << format("%.2f", before) << " -> " << format("%.2f", after) << ", "
+               << (!profitable ? "kept" : legal ? "interchanged" : "kept, dependence") << "\n";
+    }
+    if (!legal) return false;
+
+    BranchInst *OuterBr = OuterC.Br, *InnerBr = InnerC.Br;
+    moveControl(OuterC, InnerHeader, OuterHeader, InnerLatch, InnerBr);
+    moveControl(InnerC, OuterHeader, Outer->getLoopPreheader(), OuterLatch, OuterBr);
+    OuterBr->eraseFromParent();
+    InnerBr->eraseFromParent();
+    SE.forgetLoop(Outer);
+    return true;
+}
+
+/*Runs -interchange on the loop pairs of F, outermost pairs first*/
+static bool interchangeLoops(Function &F, DominatorTree &DT, LoopInfo &LI)
+{
+    TargetLibraryInfoImpl TLII(Triple(F.getParent()->getTargetTriple()));
+    TargetLibraryInfo TLI(TLII);
+    AssumptionCache AC(F);
+    ScalarEvolution SE(F, TLI, AC, DT, LI);
+    BasicAAResult BAR(F.getParent()->getDataLayout(), F, TLI, AC, &DT);
+    AAResults AA(TLI);
+    AA.addAAResult(BAR);
+    DependenceInfo DI(&F, &AA, &SE, &LI);
+    bool changed = false;
+
+    for (auto L: LI.getLoopsInPreorder()) {
+        if (isColdLoop(L) || !interchangeNest(L, SE, DI)) continue;
+        LICMInterchanged++;
+        changed = true;
+    }
+    return changed;
+}
+
+/*Returns the only block outside C that branches into C, or nullptr if
+  there is more than one*/
+static BasicBlock *cycleEntryPredecessor(const Cycle *C)
+{
+    BasicBlock *Pred = nullptr;
+    for (auto Entry: C->entries()) {
+        for (auto PredBB: predecessors(Entry)) {
+            if (C->contains(PredBB)) continue;
+            if (Pred != nullptr && Pred != PredBB) return nullptr;
+            Pred = PredBB;
+        }
+    }
+    return Pred;
+}
+
+/*Hoists invariant instructions out of the irreducible cycle C to the end of
+  its entry predecessor. Natural loops get a preheader and their exits
+  bound which loads may move; a cycle has neither, so everything moved has
+  to be safe to speculate, and loads only move if nothing in C writes
+  memory.*/
+static void hoistCycle(const Cycle *C, DominatorTree &DT)
+{
+    for (auto Child: C->children()) hoistCycle(Child, DT);
+    if (C->isReducible()) return;
+    BasicBlock *Pred = cycleEntryPredecessor(C);
+    if (Pred == nullptr) return;
+    Instruction *InsertPt = Pred->getTerminator();
+
+    bool writes = false;
+    for (auto bb: C->blocks()) {
+        for (auto &Inst: *bb) {
+            auto *CB = dyn_cast<CallBase>(&Inst);
+            if (Inst.mayWriteToMemory() || (CB != nullptr && callBlocksLoadHoist(CB))) writes = true;
+        }
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto bb: C->blocks()) {
+            for (auto it = bb->begin(); it != bb->end();) {
+                Instruction *I = &*it++;
+                if (isa<PHINode>(I) || I->isEHPad() || I->isTerminator() || !isSafeToSpeculativelyExecute(I))
+                    continue;
+                if (I->mayReadFromMemory() && (writes || !isa<LoadInst>(I) || I->isVolatile())) continue;
+                bool invariant = true;
+                for (auto &Op: I->operands()) {
+                    auto *OpI = dyn_cast<Instruction>(Op);
+                    if (OpI != nullptr && !DT.dominates(OpI, InsertPt)) invariant = false;
+                }
+                if (!invariant) continue;
+                I->moveBefore(InsertPt);
+                LICMCycleHoist++;
+                changed = true;
+            }
+        }
+    }
+}
+
+/*Runs -irreducible-cycles over the cycles of F that LoopInfo does not see*/
+static void hoistIrreducibleCycles(Function &F)
+{
+    CycleInfo CI;
+    CI.compute(F);
+    DominatorTree DT(F);
+    for (auto C: CI.toplevel_cycles()) hoistCycle(C, DT);
+}
+
+/*Returns true if -inline-loop-calls may inline Callee into Caller. Callees
+  marked noinline or optnone, callees that call themselves or Caller, and
+  callees that call setjmp-like functions are skipped. Front ends mark every
+  function noinline at -O0, so such bitcode gets nothing inlined.*/
+static bool isInlineCandidate(Function *Caller, Function *Callee, unsigned &size)
+{
+    if (Callee == nullptr || Callee->isDeclaration() || Callee->isVarArg() || Callee == Caller) return false;
+    if (Callee->hasFnAttribute(Attribute::NoInline) || Callee->hasFnAttribute(Attribute::OptimizeNone) ||
+        Callee->hasFnAttribute(Attribute::ReturnsTwice))
+        return false;
+
+    size = 0;
+    for (auto &bb: *Callee) {
+        for (auto &Inst: bb) {
+            size++;
+            auto *CB = dyn_cast<CallBase>(&Inst);
+            if (CB == nullptr) continue;
+            Function *F = CB->getCalledFunction();
+            if (F == Callee || F == Caller || CB->hasFnAttr(Attribute::ReturnsTwice)) return false;
+        }
+    }
+    return true;
+}
+
+/*Inlines direct calls inside loops whose callees fit the budget. Without a
+  profile the block frequencies are static estimates of about 32 iterations
+  per loop, so the budget grows by one -inline-budget for each such factor of
+  hotness, up to -inline-max-scale. A -use-loop-profile replaces the estimate
+  by the measured trip counts, and calls in loops it never saw entered are
+  left alone. Calls in the inlined bodies are not inlined again.*/
+static void inlineLoopCalls(Module &M)
+{
+    for (auto &F: M) {
+        if (F.empty()) continue;
+
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        if (LI.empty()) continue;
+        BranchProbabilityInfo BPI(F, LI);
+        BlockFrequencyInfo BFI(F, BPI, LI);
+        uint64_t EntryFreq = std::max<uint64_t>(BFI.getEntryFreq(), 1);
+
+        SmallVector<CallBase *, 8> Calls;
+        for (auto &bb: F) {
+            if (LI.getLoopFor(&bb) == nullptr) continue;
+            uint64_t Hotness = BFI.getBlockFreq(&bb).getFrequency() / EntryFreq;
+            LoopCounts C;
+            if (loopCounts(LI.getLoopFor(&bb), C)) {
+                /*measured: iterations per entry of each enclosing loop*/
+                Hotness = 1;
+                for (Loop *L = LI.getLoopFor(&bb); L != nullptr && loopCounts(L, C); L = L->getParentLoop())
+                    Hotness = C.Entries ? Hotness * std::max<uint64_t>(C.Iterations / C.Entries, 1) : 0;
+                if (Hotness == 0) continue;
+            }
+            unsigned scale = std::min<unsigned>(1 + Log2_64(std::max<uint64_t>(Hotness, 1)) / 5, InlineMaxScale);
+            for (auto &Inst: bb) {
+                auto *CB = dyn_cast<CallBase>(&Inst);
+                unsigned size;
+                if (CB == nullptr || CB->isNoInline() || !isInlineCandidate(&F, CB->getCalledFunction(), size)) continue;
+                if (size <= InlineBudget * scale) Calls.push_back(CB);
+            }
+        }
+
+        for (auto CB: Calls) {
+            InlineFunctionInfo IFI;
+            if (InlineFunction(*CB, IFI).isSuccess()) LICMInlined++;
+        }
+    }
+}
+
+/*Folds the instructions and branches of a clone whose arguments were
+  replaced by constants*/
+static void foldSpecialization(Function &F)
+{
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    for (auto &bb: F) {
+        for (auto it = bb.begin(); it != bb.end();) {
+            Instruction *I = &*it++;
+            if (Value *V = SimplifyInstruction(I, SimplifyQuery(DL))) {
+                I->replaceAllUsesWith(V);
+                if (isInstructionTriviallyDead(I)) I->eraseFromParent();
+            }
+        }
+        ConstantFoldTerminator(&bb, true);
+    }
+    removeUnreachableBlocks(F);
+}
+
+/*Returns a clone of Callee with the constant arguments of CB substituted,
+  or nullptr if CB has none. Clones are shared by calls passing the same
+  constants.*/
+static Function *specializeConstants(CallBase *CB, Function *Callee, std::map<std::string, Function *> &Clones)
+{
+    ValueToValueMapTy VMap;
+    std::string Key = Callee->getName().str();
+    raw_string_ostream KeyOS(Key);
+    for (auto &Arg: Callee->args()) {
+        auto *C = dyn_cast<Constant>(CB->getArgOperand(Arg.getArgNo()));
+        if (C == nullptr || isa<UndefValue>(C)) continue;
+        VMap[&Arg] = C;
+        KeyOS << "," << Arg.getArgNo() << "=";
+        C->printAsOperand(KeyOS, false);
+    }
+    if (VMap.empty()) return nullptr;
+
+    Function *&Clone = Clones[KeyOS.str()];
+    if (Clone == nullptr) {
+        Clone = CloneFunction(Callee, VMap);
+        Clone->setName(Callee->getName() + ".const");
+        Clone->setLinkage(GlobalValue::InternalLinkage);
+        foldSpecialization(*Clone);
+    }
+    return Clone;
+}
+
+/*Collects the setup of F into Setup: the entry block instructions that
+  only depend on the Invariant arguments and can be executed anywhere.
+  Outputs receives the setup values that the rest of F uses.*/
+static void findSetup(Function *F, const SmallPtrSetImpl<Argument *> &Invariant,
+                      SmallVectorImpl<Instruction *> &Setup, SmallVectorImpl<Instruction *> &Outputs)
+{
+    SmallPtrSet<Value *, 16> InSetup(Invariant.begin(), Invariant.end());
+    for (auto &Inst: F->getEntryBlock()) {
+        if (isa<PHINode>(&Inst) || Inst.isEHPad() || Inst.mayReadFromMemory() || !isSafeToSpeculativelyExecute(&Inst))
+            continue;
+        bool dependent = false;
+        for (auto &Op: Inst.operands()) {
+            if (!isa<Constant>(Op) && !InSetup.count(Op)) dependent = true;
+        }
+        if (dependent) continue;
+        Setup.push_back(&Inst);
+        InSetup.insert(&Inst);
+    }
+    for (auto I: Setup) {
+        for (auto U: I->users()) {
+            if (!InSetup.count(U)) {
+                Outputs.push_back(I);
+                break;
+            }
+        }
+    }
+}
+
+/*Returns a clone of F that takes the setup Outputs as extra parameters
+  instead of computing them*/
+static Function *splitSetup(Function *F, ArrayRef<Instruction *> Outputs)
+{
+    SmallVector<Type *, 8> Params(F->getFunctionType()->params().begin(), F->getFunctionType()->params().end());
+    for (auto I: Outputs) Params.push_back(I->getType());
+    FunctionType *FTy = FunctionType::get(F->getReturnType(), Params, false);
+    Function *Clone = Function::Create(FTy, GlobalValue::InternalLinkage, F->getName() + ".setup", F->getParent());
+
+    ValueToValueMapTy VMap;
+    auto NewArg = Clone->arg_begin();
+    for (auto &Arg: F->args()) {
+        NewArg->setName(Arg.getName());
+        VMap[&Arg] = &*NewArg++;
+    }
+    SmallVector<ReturnInst *, 4> Returns;
+    CloneFunctionInto(Clone, F, VMap, CloneFunctionChangeType::LocalChangesOnly, Returns);
+
+    for (auto I: Outputs) {
+        auto *Cloned = cast<Instruction>(VMap[I]);
+        NewArg->setName(I->getName() + ".in");
+        Cloned->replaceAllUsesWith(&*NewArg++);
+        RecursivelyDeleteTriviallyDeadInstructions(Cloned);
+    }
+    return Clone;
+}
+
+/*Specializes the calls inside the loops of F. Constant arguments are
+  substituted into a clone of the callee. For arguments LICM left invariant
+  in the loop, the setup the callee computes from them is recomputed once
+  in the preheader and passed to a clone that skips it.*/
+static void specializeLoopCalls(Function &F, std::map<std::string, Function *> &Clones)
+{
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+
+    SmallVector<std::pair<CallInst *, Loop *>, 8> Calls;
+    for (auto &bb: F) {
+        Loop *L = LI.getLoopFor(&bb);
+        if (L == nullptr) continue;
+        for (auto &Inst: bb) {
+            auto *CI = dyn_cast<CallInst>(&Inst);
+            unsigned size;
+            if (CI == nullptr || CI->isMustTailCall() || !isInlineCandidate(&F, CI->getCalledFunction(), size))
+                continue;
+            if (size <= SpecializeBudget && CI->getFunctionType() == CI->getCalledFunction()->getFunctionType())
+                Calls.push_back({CI, L});
+        }
+    }
+
+    for (auto &Call: Calls) {
+        CallInst *CI = Call.first;
+        Loop *L = Call.second;
+        Function *Callee = CI->getCalledFunction();
+        bool byValue = false;
+        for (auto &Arg: Callee->args()) byValue |= Arg.hasPassPointeeByValueCopyAttr() || Arg.hasStructRetAttr();
+        if (byValue) continue;
+
+        /*the constant clone drops the substituted parameters; ArgNos keeps
+          the original position of every remaining argument for its
+          attributes*/
+        SmallVector<Value *, 8> Args;
+        SmallVector<unsigned, 8> ArgNos;
+        Function *Target = specializeConstants(CI, Callee, Clones);
+        for (auto &Arg: Callee->args()) {
+            auto *C = dyn_cast<Constant>(CI->getArgOperand(Arg.getArgNo()));
+            if (Target == nullptr || C == nullptr || isa<UndefValue>(C)) {
+                Args.push_back(CI->getArgOperand(Arg.getArgNo()));
+                ArgNos.push_back(Arg.getArgNo());
+            }
+        }
+        if (Target != nullptr) LICMSpecialized++;
+        else Target = Callee;
+
+        SmallPtrSet<Argument *, 8> Invariant;
+        BasicBlock *Preheader = L->getLoopPreheader();
+        for (auto &Arg: Target->args()) {
+            Value *V = Args[Arg.getArgNo()];
+            if (Preheader != nullptr && !isa<Constant>(V) && L->isLoopInvariant(V)) Invariant.insert(&Arg);
+        }
+        SmallVector<Instruction *, 8> Setup, Outputs;
+        if (!Invariant.empty()) findSetup(Target, Invariant, Setup, Outputs);
+
+        if (!Outputs.empty()) {
+            std::string Key = Target->getName().str() + ".setup";
+            for (auto Arg: Invariant) Key += "," + utostr(Arg->getArgNo());
+            Function *&Split = Clones[Key];
+            if (Split == nullptr) Split = splitSetup(Target, Outputs);
+
+            ValueToValueMapTy VMap;
+            for (auto &Arg: Target->args()) VMap[&Arg] = Args[Arg.getArgNo()];
+            for (auto I: Setup) {
+                Instruction *Copy = I->clone();
+                Copy->setName(I->getName());
+                Copy->insertBefore(Preheader->getTerminator());
+                RemapInstruction(Copy, VMap, RF_IgnoreMissingLocals);
+                VMap[I] = Copy;
+                LICMSetupHoisted++;
+            }
+            for (auto I: Outputs) Args.push_back(VMap[I]);
+            Target = Split;
+        }
+        if (Target == Callee) continue;
+
+        AttributeList Attrs = CI->getAttributes();
+        SmallVector<AttributeSet, 8> ParamAttrs;
+        for (auto No: ArgNos) ParamAttrs.push_back(Attrs.getParamAttrs(No));
+        /*the setup outputs appended to Args have no attributes*/
+        ParamAttrs.resize(Args.size());
+
+        CallInst *NewCI = CallInst::Create(Target, Args, "", CI);
+        NewCI->takeName(CI);
+        NewCI->setAttributes(AttributeList::get(CI->getContext(), Attrs.getFnAttrs(), Attrs.getRetAttrs(), ParamAttrs));
+        NewCI->setCallingConv(CI->getCallingConv());
+        NewCI->setTailCallKind(CI->getTailCallKind());
+        NewCI->setDebugLoc(CI->getDebugLoc());
+        CI->replaceAllUsesWith(NewCI);
+        CI->eraseFromParent();
+    }
+}
+
+/*Attaches the trip counts of -use-loop-profile to the loops of M as
+  p3.loop.profile properties, which later transformations keep with the
+  loop*/
+static void attachLoopProfile(Module &M)
+{
+    LLVMContext &Ctx = M.getContext();
+    Type *I64 = Type::getInt64Ty(Ctx);
+    for (auto &F: M) {
+        if (F.empty()) continue;
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        unsigned Index = 0;
+        for (auto L: LI.getLoopsInPreorder()) {
+            auto It = LoopProfile.find(loopKey(F, Index++));
+            if (It == LoopProfile.end()) continue;
+            Metadata *Ops[] = {MDString::get(Ctx, "p3.loop.profile"),
+                               ConstantAsMetadata::get(ConstantInt::get(I64, It->second.Entries)),
+                               ConstantAsMetadata::get(ConstantInt::get(I64, It->second.Iterations))};
+            setLoopProperty(L, MDTuple::get(Ctx, Ops));
+        }
+    }
+}
+
+/*Adds one 64-bit counter increment of field Field of record Record of the
+  profile global in front of InsertPt*/
+static void incrementCounter(GlobalVariable *Profile, unsigned Record, unsigned Field, Instruction *InsertPt)
+{
+    IRBuilder<> B(InsertPt);
+    Value *Idx[] = {B.getInt32(0), B.getInt32(2), B.getInt32(Record), B.getInt32(Field)};
+    Value *Ptr = B.CreateInBoundsGEP(Profile->getValueType(), Profile, Idx);
+    Value *Count = B.CreateLoad(B.getInt64Ty(), Ptr);
+    B.CreateStore(B.CreateAdd(Count, B.getInt64(1)), Ptr);
+}
+
+/*-instrument-loops: counts the preheader (entries) and header (iterations)
+  executions of every loop in a global laid out as a loop profile. A
+  destructor writes the global to -loop-profile-output, so the program has
+  to return from main or call exit. The counters are not atomic.*/
+static void instrumentLoops(Module &M)
+{
+    LLVMContext &Ctx = M.getContext();
+    Type *I64 = Type::getInt64Ty(Ctx);
+    SmallVector<std::pair<Loop *, uint64_t>, 16> Loops;
+    std::vector<std::unique_ptr<LoopInfo>> LIs;
+
+    for (auto &F: M) {
+        if (F.empty()) continue;
+        DominatorTree DT(F);
+        LIs.emplace_back(new LoopInfo(DT));
+        unsigned Index = 0;
+        for (auto L: LIs.back()->getLoopsInPreorder()) {
+            uint64_t Key = loopKey(F, Index++);
+            if (L->getLoopPreheader() != nullptr || InsertPreheaderForLoop(L, &DT, LIs.back().get(), nullptr, false))
+                Loops.push_back({L, Key});
+        }
+    }
+    if (Loops.empty()) return;
+
+    ArrayType *RecordTy = ArrayType::get(I64, 3);
+    ArrayType *RecordsTy = ArrayType::get(RecordTy, Loops.size());
+    StructType *ProfileTy = StructType::get(ArrayType::get(Type::getInt8Ty(Ctx), 4), Type::getInt32Ty(Ctx), RecordsTy);
+    std::vector<Constant *> Records;
+    for (auto &L: Loops) {
+        Constant *Fields[] = {ConstantInt::get(I64, L.second), ConstantInt::get(I64, 0), ConstantInt::get(I64, 0)};
+        Records.push_back(ConstantArray::get(RecordTy, Fields));
+    }
+    Constant *Init = ConstantStruct::get(ProfileTy, {ConstantDataArray::getString(Ctx, "P3LP", false),
+                                                     ConstantInt::get(Type::getInt32Ty(Ctx), Loops.size()),
+                                                     ConstantArray::get(RecordsTy, Records)});
+    auto *Profile = new GlobalVariable(M, ProfileTy, false, GlobalValue::InternalLinkage, Init, "__p3_loop_profile");
+
+    for (unsigned r = 0; r < Loops.size(); r++) {
+        Loop *L = Loops[r].first;
+        incrementCounter(Profile, r, 1, L->getLoopPreheader()->getTerminator());
+        incrementCounter(Profile, r, 2, &*L->getHeader()->getFirstInsertionPt());
+        LICMInstrumented++;
+    }
+
+    /*void __p3_dump_loop_profile() { if (f = fopen(out, "wb")) { fwrite(...); fclose(f); } }*/
+    const DataLayout &DL = M.getDataLayout();
+    Type *SizeTy = DL.getIntPtrType(Ctx);
+    Type *PtrTy = Type::getInt8PtrTy(Ctx);
+    FunctionCallee FOpen = M.getOrInsertFunction("fopen", PtrTy, PtrTy, PtrTy);
+    FunctionCallee FWrite = M.getOrInsertFunction("fwrite", SizeTy, PtrTy, SizeTy, SizeTy, PtrTy);
+    FunctionCallee FClose = M.getOrInsertFunction("fclose", Type::getInt32Ty(Ctx), PtrTy);
+    Function *Dump = Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false), GlobalValue::InternalLinkage,
+                                      "__p3_dump_loop_profile", M);
+    BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", Dump);
+    BasicBlock *Write = BasicBlock::Create(Ctx, "write", Dump);
+    BasicBlock *Done = BasicBlock::Create(Ctx, "done", Dump);
+    IRBuilder<> B(Entry);
+    Value *File = B.CreateCall(FOpen, {B.CreateGlobalStringPtr(LoopProfileOutput), B.CreateGlobalStringPtr("wb")});
+    B.CreateCondBr(B.CreateIsNull(File), Done, Write);
+    B.SetInsertPoint(Write);
+    B.CreateCall(FWrite, {B.CreateBitCast(Profile, PtrTy), ConstantInt::get(SizeTy, DL.getTypeAllocSize(ProfileTy)),
+                          ConstantInt::get(SizeTy, 1), File});
+    B.CreateCall(FClose, {File});
+    B.CreateBr(Done);
+    B.SetInsertPoint(Done);
+    B.CreateRetVoid();
+    appendToGlobalDtors(M, Dump, 0);
+}
+
+/*Runs -specialize-calls over M and drops the clones that ended up unused,
+  e.g. constant clones that were only a step towards a setup split*/
+static void specializeCalls(Module &M)
+{
+    std::map<std::string, Function *> Clones;
+    std::vector<Function *> Functions;
+    for (auto &F: M) {
+        if (!F.empty()) Functions.push_back(&F);
+    }
+    for (auto F: Functions) specializeLoopCalls(*F, Clones);
+    for (auto &Clone: Clones) {
+        if (Clone.second->use_empty()) Clone.second->eraseFromParent();
+    }
+}
+
+/*Adds I and the instructions of L it depends on to Slice*/
+static void addSlice(Loop *L, Instruction *I, SmallPtrSetImpl<Instruction *> &Slice)
+{
+    if (!L->contains(I) || !Slice.insert(I).second) return;
+    for (auto &Op: I->operands()) {
+        if (auto *OpI = dyn_cast<Instruction>(Op)) addSlice(L, OpI, Slice);
+    }
+}
+
+/*Partitions the innermost loop L into the slices of its stores (Stores) and
+  of its live-out values (Rest). Both include the slice of the control flow. Fails if L has other side
+  effects, or if a load in Rest may read what a store writes, since Rest
+  then cannot run after all the stores.*/
+static bool partitionLoop(Loop *L, AAResults &AA, SmallPtrSetImpl<Instruction *> &Stores,
+                          SmallPtrSetImpl<Instruction *> &Rest)
+{
+    SmallVector<StoreInst *, 4> StoreInsts;
+    for (auto bb: L->blocks()) {
+        addSlice(L, bb->getTerminator(), Rest);
+        addSlice(L, bb->getTerminator(), Stores);
+        for (auto &Inst: *bb) {
+            auto *SI = dyn_cast<StoreInst>(&Inst);
+            if (SI != nullptr && SI->isSimple()) StoreInsts.push_back(SI);
+            else if (Inst.mayHaveSideEffects() || (isa<CallBase>(&Inst) && !isa<DbgInfoIntrinsic>(&Inst))) return false;
+            for (auto U: Inst.users()) {
+                if (!L->contains(cast<Instruction>(U))) addSlice(L, &Inst, Rest);
+            }
+        }
+    }
+    if (StoreInsts.empty()) return false;
+    for (auto SI: StoreInsts) {
+        addSlice(L, SI, Stores);
+        for (auto I: Rest) {
+            auto *LoadI = dyn_cast<LoadInst>(I);
+            if (LoadI == nullptr) continue;
+            if (!LoadI->isSimple() ||
+                !AA.isNoAlias(MemoryLocation::getBeforeOrAfter(LoadI->getPointerOperand()),
+                              MemoryLocation::getBeforeOrAfter(SI->getPointerOperand())))
+                return false;
+        }
+    }
+    return true;
+}
+
+/*Removes the instructions of Blocks that are not in Keep*/
+static void pruneLoop(ArrayRef<BasicBlock *> Blocks, const SmallPtrSetImpl<Instruction *> &Keep)
+{
+    for (auto bb: Blocks) {
+        for (auto it = bb->begin(); it != bb->end();) {
+            Instruction *I = &*it++;
+            if (Keep.count(I)) continue;
+            I->replaceAllUsesWith(UndefValue::get(I->getType()));
+            I->eraseFromParent();
+        }
+    }
+}
+
+/*Distributes innermost loops in which a store is all that keeps
+  canMoveOutOfLoop from hoisting a load. A copy of the loop that only does
+  the stores runs first; the original loop keeps the control flow, the
+  loads and the live-out values but no stores, so LICM can hoist the load.
+  BasicAA has to prove that no store writes what the store-free loop reads.*/
+static bool distributeLoops(Function &F, DominatorTree &DT, LoopInfo &LI)
+{
+    TargetLibraryInfoImpl TLII(Triple(F.getParent()->getTargetTriple()));
+    TargetLibraryInfo TLI(TLII);
+    AssumptionCache AC(F);
+    BasicAAResult BAR(F.getParent()->getDataLayout(), F, TLI, AC, &DT);
+    AAResults AA(TLI);
+    AA.addAAResult(BAR);
+    bool changed = false;
+
+    auto Loops = LI.getLoopsInPreorder();
+    for (auto L: Loops) {
+        BasicBlock *Preheader = L->getLoopPreheader();
+        BasicBlock *Exiting = L->getExitingBlock();
+        if (!L->isInnermost() || Preheader == nullptr || Exiting == nullptr || L->getExitBlock() == nullptr ||
+            isColdLoop(L))
+            continue;
+
+        bool blocked = false;
+        for (auto bb: L->blocks()) {
+            for (auto &Inst: *bb) {
+                bool sawStore = false;
+                if (isa<LoadInst>(&Inst) && L->isLoopInvariant(cast<LoadInst>(&Inst)->getPointerOperand()) &&
+                    loadHoistBlocker(L, &Inst, &DT, sawStore) == HB_Store)
+                    blocked = true;
+            }
+        }
+        SmallPtrSet<Instruction *, 32> Stores, Rest;
+        if (!blocked || !partitionLoop(L, AA, Stores, Rest)) continue;
+
+        /*the copy doing the stores is placed between Preheader and a new
+          preheader of L, and leaves to that new preheader*/
+        BasicBlock *NewPreheader = SplitBlock(Preheader, Preheader->getTerminator(), &DT, &LI);
+        ValueToValueMapTy VMap;
+        SmallVector<BasicBlock *, 8> Blocks;
+        Loop *Copy = cloneLoopWithPreheader(NewPreheader, Preheader, L, VMap, ".dist", &LI, &DT, Blocks);
+        VMap[L->getExitBlock()] = NewPreheader;
+        remapInstructionsInBlocks(Blocks, VMap);
+        Preheader->getTerminator()->replaceUsesOfWith(NewPreheader, Copy->getLoopPreheader());
+        DT.changeImmediateDominator(NewPreheader, cast<BasicBlock>(VMap[Exiting]));
+
+        SmallPtrSet<Instruction *, 32> CopyKeep;
+        for (auto I: Stores) CopyKeep.insert(cast<Instruction>(VMap[I]));
+        pruneLoop(Copy->getBlocks(), CopyKeep);
+        pruneLoop(L->getBlocks(), Rest);
+        LICMDistributed++;
+        changed = true;
+    }
+    return changed;
+}
+
+/*An access of a -commoning chain: it reads or writes the address the chain's
+  first access uses Offset iterations later*/
+struct ChainAccess {
+    Instruction *I;
+    int64_t Offset;
+};
+
+/*Returns the affine pointer of the load or store I in L with a constant
+  step, or nullptr*/
+static const SCEVAddRecExpr *affineAccess(Loop *L, Instruction *I, ScalarEvolution &SE)
+{
+    Value *Ptr = getLoadStorePointerOperand(I);
+    if (Ptr == nullptr) return nullptr;
+    if (auto *SI = dyn_cast<StoreInst>(I)) {
+        if (!SI->isSimple()) return nullptr;
+    } else if (!cast<LoadInst>(I)->isSimple()) {
+        return nullptr;
+    }
+    auto *AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(Ptr));
+    if (AR == nullptr || AR->getLoop() != L || !AR->isAffine()) return nullptr;
+    auto *Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+    if (Step == nullptr || Step->getAPInt().isZero()) return nullptr;
+    return AR;
+}
+
+/*Checks that Chain can be carried in registers: its loads cover every
+  offset from the lowest up to the leader, an optional store is the leader,
+  and nothing else in L may write the chain's memory. Sorts Chain by
+  offset.*/
+static bool isCommonableChain(Loop *L, SmallVectorImpl<ChainAccess> &Chain, AAResults &AA)
+{
+    std::stable_sort(Chain.begin(), Chain.end(),
+                     [](const ChainAccess &A, const ChainAccess &B) { return A.Offset < B.Offset; });
+    int64_t Lowest = Chain.front().Offset, Highest = Chain.back().Offset;
+    if (Highest == Lowest || (uint64_t)(Highest - Lowest) > CommoningDistance) return false;
+
+    SmallVector<bool, 8> Covered(Highest - Lowest + 1, false);
+    for (auto &A: Chain) {
+        if (isa<StoreInst>(A.I) && (&A != &Chain.back() || Chain[Chain.size() - 2].Offset == Highest))
+            return false;
+        Covered[A.Offset - Lowest] = true;
+    }
+    if (std::find(Covered.begin(), Covered.end(), false) != Covered.end()) return false;
+
+    Value *Ptr = getLoadStorePointerOperand(Chain.front().I);
+    for (auto bb: L->blocks()) {
+        for (auto &Inst: *bb) {
+            auto *CB = dyn_cast<CallBase>(&Inst);
+            if (CB != nullptr && callBlocksLoadHoist(CB)) return false;
+            if (&Inst == Chain.back().I || !Inst.mayWriteToMemory()) continue;
+            Value *WritePtr = nullptr;
+            if (auto *SI = dyn_cast<StoreInst>(&Inst)) WritePtr = SI->getPointerOperand();
+            else if (auto *RMW = dyn_cast<AtomicRMWInst>(&Inst)) WritePtr = RMW->getPointerOperand();
+            else if (auto *CX = dyn_cast<AtomicCmpXchgInst>(&Inst)) WritePtr = CX->getPointerOperand();
+            /*fences, memory intrinsics and other calls count as aliasing*/
+            if (WritePtr == nullptr || !AA.isNoAlias(MemoryLocation::getBeforeOrAfter(Ptr),
+                                                     MemoryLocation::getBeforeOrAfter(WritePtr)))
+                return false;
+        }
+    }
+    return true;
+}
+
+/*Replaces the loads of Chain below the leader by a ladder of header phis
+  that carry the leader's value one iteration further each. The phis start
+  with the values the loads read in the first iteration, loaded in the
+  preheader.*/
+static void commonChain(Loop *L, ArrayRef<ChainAccess> Chain, ScalarEvolution &SE)
+{
+    Instruction *Leader = Chain.back().I;
+    Value *LeaderValue = Leader;
+    if (auto *SI = dyn_cast<StoreInst>(Leader)) LeaderValue = SI->getValueOperand();
+    Type *Ty = LeaderValue->getType();
+    auto *AR = cast<SCEVAddRecExpr>(SE.getSCEV(getLoadStorePointerOperand(Leader)));
+    auto *Step = cast<SCEVConstant>(AR->getStepRecurrence(SE));
+    int64_t Highest = Chain.back().Offset;
+    unsigned Distance = Highest - Chain.front().Offset;
+
+    BasicBlock *Preheader = L->getLoopPreheader();
+    BasicBlock *Latch = L->getLoopLatch();
+    SCEVExpander Expander(SE, Preheader->getModule()->getDataLayout(), "pc");
+    SmallVector<PHINode *, 4> Phis;
+    for (unsigned d = 1; d <= Distance; d++) {
+        LoadInst *Orig = nullptr;
+        for (auto &A: Chain) {
+            if (Highest - A.Offset == d) Orig = cast<LoadInst>(A.I);
+        }
+        const SCEV *Addr = SE.getAddExpr(AR->getStart(), SE.getMulExpr(Step, SE.getConstant(Step->getType(), -(int64_t)d, true)));
+        Value *Ptr = Expander.expandCodeFor(Addr, Orig->getPointerOperandType(), Preheader->getTerminator());
+        auto *Init = new LoadInst(Ty, Ptr, Orig->getName() + ".init", false, Orig->getAlign(), Preheader->getTerminator());
+
+        PHINode *Phi = PHINode::Create(Ty, 2, Orig->getName() + ".carried", &L->getHeader()->front());
+        Phi->addIncoming(Init, Preheader);
+        Phi->addIncoming(d == 1 ? LeaderValue : Phis.back(), Latch);
+        Phis.push_back(Phi);
+    }
+    for (auto &A: Chain) {
+        if (A.Offset == Highest) continue;
+        A.I->replaceAllUsesWith(Phis[Highest - A.Offset - 1]);
+        A.I->eraseFromParent();
+        LICMCommoned++;
+    }
+}
+
+/*Predictive commoning: in innermost loops, loads of an address that an
+  earlier iteration already loaded or stored take the value from a phi. Only
+  accesses executed on every iteration qualify, so each preheader load
+  repeats a load of the first iteration.*/
+static bool commonLoopAccesses(Function &F, DominatorTree &DT, LoopInfo &LI)
+{
+    TargetLibraryInfoImpl TLII(Triple(F.getParent()->getTargetTriple()));
+    TargetLibraryInfo TLI(TLII);
+    AssumptionCache AC(F);
+    ScalarEvolution SE(F, TLI, AC, DT, LI);
+    BasicAAResult BAR(F.getParent()->getDataLayout(), F, TLI, AC, &DT);
+    AAResults AA(TLI);
+    AA.addAAResult(BAR);
+    bool changed = false;
+
+    for (auto L: LI.getLoopsInPreorder()) {
+        if (!L->isInnermost()) continue;
+        simplifyLoop(L, &DT, &LI, &SE, &AC, nullptr, false);
+        BasicBlock *Latch = L->getLoopLatch();
+        if (L->getLoopPreheader() == nullptr || Latch == nullptr) continue;
+        SmallVector<BasicBlock *, 4> Exiting;
+        L->getExitingBlocks(Exiting);
+
+        SmallVector<SmallVector<ChainAccess, 4>, 4> Chains;
+        SmallVector<const SCEVAddRecExpr *, 4> Leads;
+        for (auto bb: L->blocks()) {
+            bool everyIteration = DT.dominates(bb, Latch);
+            for (auto Exit: Exiting) everyIteration &= DT.dominates(bb, Exit);
+            if (!everyIteration) continue;
+            for (auto &Inst: *bb) {
+                const SCEVAddRecExpr *AR = affineAccess(L, &Inst, SE);
+                if (AR == nullptr) continue;
+                Type *Ty = getLoadStoreType(&Inst);
+                const APInt &Step = cast<SCEVConstant>(AR->getStepRecurrence(SE))->getAPInt();
+                bool added = false;
+                for (unsigned c = 0; c < Chains.size() && !added; c++) {
+                    if (getLoadStoreType(Chains[c].front().I) != Ty || Leads[c]->getStepRecurrence(SE) != AR->getStepRecurrence(SE))
+                        continue;
+                    auto *Diff = dyn_cast<SCEVConstant>(SE.getMinusSCEV(AR, Leads[c]));
+                    if (Diff == nullptr || Diff->getAPInt().srem(Step) != 0) continue;
+                    Chains[c].push_back({&Inst, Diff->getAPInt().sdiv(Step).getSExtValue()});
+                    added = true;
+                }
+                if (!added) {
+                    Chains.push_back({{&Inst, 0}});
+                    Leads.push_back(AR);
+                }
+            }
+        }
+
+        for (auto &Chain: Chains) {
+            if (Chain.size() < 2 || !isCommonableChain(L, Chain, AA)) continue;
+            commonChain(L, Chain, SE);
+            changed = true;
+        }
+        if (changed) SE.forgetLoop(L);
+    }
+    return changed;
+}
+
+/*Runs the enabled stages that change the CFG in front of LICM. They share
+  one DominatorTree and LoopInfo, which every stage keeps up to date.*/
+static void runPreStages(Function &F)
+{
+    bool preheaders = OptLevel >= 2;
+    bool rotate = Rotate || OptLevel >= 3;
+    bool interchange = Interchange;
+    bool devirtualize = Devirtualize;
+    bool promote = PromoteGlobals || OptLevel >= 3;
+    bool distribute = Distribute;
+    bool commoning = Commoning;
+    bool peel = PeelFirst;
+    bool guards = HoistGuards;
+    if (DryRun || !(preheaders || rotate || interchange || devirtualize || promote || distribute || commoning || peel || guards)) return;
+
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    if (preheaders) insertPreheaders(F, DT, LI);
+    if (rotate) rotateLoops(F, DT, LI);
+    if (interchange) interchangeLoops(F, DT, LI);
+    if (devirtualize) devirtualizeLoops(F, DT, LI);
+    if (promote) promoteGlobals(F, DT, LI);
+    if (distribute) distributeLoops(F, DT, LI);
+    if (commoning) commonLoopAccesses(F, DT, LI);
+    if (peel) peelFirstIterations(F, DT, LI);
+    if (guards) hoistInvariantGuards(F, DT, LI);
+}
+
+/*Returns true if mLICM would hoist the non-memory instruction I out of L
+  through makeLoopInvariant, given the instructions already in Hoisted*/
+static bool wouldHoist(Loop *L, Instruction *I, const SmallPtrSetImpl<Instruction *> &Hoisted)
+{
+    if (isa<PHINode>(I) || I->isEHPad() || I->mayReadFromMemory() || !isSafeToSpeculativelyExecute(I))
+        return false;
+    for (auto &Op: I->operands()) {
+        auto *OpI = dyn_cast<Instruction>(Op);
+        if (OpI != nullptr && L->contains(OpI) && !Hoisted.count(OpI)) return false;
+    }
+    return true;
+}
+
+/*Returns true if Block dominates every exiting block of L*/
+static bool dominatesExits(Loop *L, BasicBlock *Block, DominatorTree *DT)
+{
+    for (auto bb: L->blocks()) {
+        if (isLoopExitingBlock(L, bb) && !DT->dominates(Block, bb)) return false;
+    }
+    return true;
+}
+
+/*Replays the rounds of mLICM on L without changing the IR, updates the
+  statistics as if they had run and prints one report line for the loop.
+  Hoisted receives what L would lose. Moved holds what the subloops of L
+  already lost, mapped to the subloop preheader it now sits in: those
+  instructions are still in L and mLICM considers them again.*/
+static void dryRunLoop(Loop *L, DominatorTree *mDT, SmallPtrSetImpl<Instruction *> &Hoisted,
+                       const DenseMap<Instruction *, BasicBlock *> &Moved)
+{
+    unsigned loads = 0, basic = 0;
+    bool sawStore = false, sawCall = false;
+    HoistBlocker Blocked = HB_None;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto bb: L->blocks()) {
+            for (auto &Inst: *bb) {
+                if (Hoisted.count(&Inst) || isa<StoreInst>(&Inst)) continue;
+                if (isa<LoadInst>(&Inst)) {
+                    if (OptLevel == 1) continue;
+                    HoistBlocker Why = loadHoistBlocker(L, &Inst, mDT, sawStore, &Hoisted);
+                    if (Why == HB_Exit && Moved.count(&Inst) && dominatesExits(L, Moved.lookup(&Inst), mDT))
+                        Why = HB_None;
+                    sawCall |= Why == HB_Call;
+                    if (Why != HB_None) {
+                        if (Blocked == HB_None) Blocked = Why;
+                        continue;
+                    }
+                    loads++;
+                } else if (wouldHoist(L, &Inst, Hoisted)) {
+                    basic++;
+                } else {
+                    continue;
+                }
+                Hoisted.insert(&Inst);
+                changed = true;
+            }
+        }
+    }
+
+    LICMLoadHoist += loads;
+    LICMBasic += basic;
+    if (sawCall) NumLoopsWithCall++;
+    if (loads && !sawStore) NumLoopsNoStores++;
+
+    outs() << L->getHeader()->getParent()->getName() << ",";
+    L->getHeader()->printAsOperand(outs(), false);
+    outs() << "," << L->getLoopDepth() << "," << loads << "," << basic << ","
+           << HoistBlockerNames[Blocked] << "\n";
+}
+
+/*Dry-run counterpart of licmLoopNest*/
+static void dryRunLoopNest(Loop *li, DominatorTree *mDT)
+{
+    if (li->getLoopPreheader() == nullptr)
+    {
+        LICMNoPreheader++;
+        return;
+    }
+    DenseMap<Instruction *, BasicBlock *> Moved;
+    for (auto subli: li->getSubLoops())
+    {
+        NumLoops++;
+        if (isColdLoop(subli)) LICMColdSkipped++;
+        else if (BasicBlock *Preheader = subli->getLoopPreheader()) {
+            SmallPtrSet<Instruction *, 32> Hoisted;
+            dryRunLoop(subli, mDT, Hoisted, DenseMap<Instruction *, BasicBlock *>());
+            for (auto I: Hoisted) Moved[I] = Preheader;
+        }
+    }
+    NumLoops++;
+    SmallPtrSet<Instruction *, 32> Hoisted;
+    if (isColdLoop(li)) LICMColdSkipped++;
+    else dryRunLoop(li, mDT, Hoisted, Moved);
+}
+
+/*Number of NUMA node IDs -threads spreads its workers over, or 0 when
+  -numa is off, p3 was built without libnuma or the machine is flat*/
+static unsigned numaNodes()
+{
+#ifdef P3_HAVE_NUMA
+    if (NUMA && numa_available() >= 0 && numa_num_configured_nodes() > 1)
+        return numa_max_node() + 1;
+#endif
+    return 0;
+}
+
+/*The node whose memory holds P, or 0 if the kernel does not say*/
+static unsigned numaNodeOf(const void *P)
+{
+#ifdef P3_HAVE_NUMA
+    int Node = -1;
+    if (get_mempolicy(&Node, nullptr, 0, const_cast<void *>(P), MPOL_F_NODE | MPOL_F_ADDR) == 0 && Node >= 0)
+        return Node;
+#endif
+    return 0;
+}
+
+/*Worker pool of -threads -numa. The workers are dealt round-robin to the
+  nodes that have CPUs, run only there and allocate node-locally, so the
+  analyses they build stay on their node. Every node has a queue; work is
+  queued on the node that holds its IR, and a worker whose queue is empty
+  takes work from the other nodes rather than idle.*/
+class NodePool {
+    std::vector<std::deque<std::function<void()>>> Queues;
+    std::vector<std::thread> Workers;
+    std::mutex Lock;
+    std::condition_variable Wake, Idle;
+    unsigned Pending = 0;
+    bool Stopping = false;
+
+    void work(unsigned Node)
+    {
+#ifdef P3_HAVE_NUMA
+        numa_run_on_node(Node);
+        numa_set_localalloc();
+#endif
+        std::unique_lock<std::mutex> Guard(Lock);
+        while (true) {
+            std::function<void()> Task;
+            for (unsigned n = 0; n < Queues.size() && !Task; n++) {
+                auto &Q = Queues[(Node + n) % Queues.size()];
+                if (Q.empty()) continue;
+                Task = std::move(Q.front());
+                Q.pop_front();
+                if (n > 0) LICMNumaRemote++;
+            }
+            if (!Task) {
+                if (Stopping) return;
+                Wake.wait(Guard);
+                continue;
+            }
+            Guard.unlock();
+            Task();
+            Guard.lock();
+            if (--Pending == 0) Idle.notify_all();
+        }
+    }
+
+public:
+    NodePool(unsigned Threads, unsigned Nodes) : Queues(Nodes)
+    {
+        std::vector<unsigned> CPUNodes;
+#ifdef P3_HAVE_NUMA
+        for (unsigned n = 0; n < Nodes; n++) {
+            struct bitmask *CPUs = numa_allocate_cpumask();
+            if (numa_node_to_cpus(n, CPUs) == 0 && numa_bitmask_weight(CPUs) > 0) CPUNodes.push_back(n);
+            numa_free_cpumask(CPUs);
+        }
+#endif
+        if (CPUNodes.empty()) CPUNodes.push_back(0);
+        for (unsigned t = 0; t < Threads; t++) {
+            unsigned Node = CPUNodes[t % CPUNodes.size()];
+            Workers.emplace_back([this, Node] { work(Node); });
+        }
+    }
+    ~NodePool()
+    {
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Stopping = true;
+        }
+        Wake.notify_all();
+        for (auto &T: Workers) T.join();
+    }
+    void async(unsigned Node, std::function<void()> Task)
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Queues[Node % Queues.size()].push_back(std::move(Task));
+        Pending++;
+        Wake.notify_one();
+    }
+    void wait()
+    {
+        std::unique_lock<std::mutex> Guard(Lock);
+        Idle.wait(Guard, [this] { return Pending == 0; });
+    }
+};
+
+/*With -threads -numa the parsed IR is interleaved over the nodes, so that
+  every node holds loop nests for its workers; everything else allocates
+  locally*/
+static void numaParsePolicy(bool Parsing)
+{
+#ifdef P3_HAVE_NUMA
+    if (Threads <= 1 || numaNodes() == 0) return;
+    if (Parsing) numa_set_interleave_mask(numa_all_nodes_ptr);
+    else numa_set_localalloc();
+#endif
+}
+
+void LoopInvariantCodeMotion(Module &M)
+{
+    std::unique_ptr<ThreadPool> Pool;
+    std::unique_ptr<NodePool> Nodes;
+    if (Threads > 1 && numaNodes() > 0)
+        Nodes.reset(new NodePool(Threads, numaNodes()));
+    else if (Threads > 1)
+        Pool.reset(new ThreadPool(hardware_concurrency(Threads)));
+    if (!LoopProfile.empty())
+        attachLoopProfile(M);
+    if (InstrumentLoops && !DryRun)
+        instrumentLoops(M);
+    if (DryRun)
+        outs() << "function,loop,depth,loads,basic,blocked\n";
+    else if (InlineLoopCalls)
+        inlineLoopCalls(M);
+
+    /*loop over all the functions in this Module M*/
+    for(auto f = M.begin(); f!=M.end(); f++)
+    {
+        if (f->empty()) continue;
+
+        runPreStages(*f);
+
+        FunctionScratch &S = functionScratch();
+        S.reset(*f); // dominance and loop info for Function, F
+        LoopInfoBase<BasicBlock, Loop> *LI = &S.LI;
+        DominatorTree &mDT = S.DT;
+
+        /*loop over all the Loops present in this function f*/
+        if (DryRun)
+        {
+            for (auto li: *LI)
+            {
+                dryRunLoopNest(li, &mDT);
+            }
+            continue;
+        }
+        if (IrreducibleCycles)
+            hoistIrreducibleCycles(*f);
+        if (selectingHoists())
+            numberHoistCandidates(*f);
+        /*see IRMutex: the workers share mDT read-only*/
+        if ((Nodes != nullptr || Pool != nullptr) && !selectingHoists() && LI->end() - LI->begin() > 1)
+            mDT.updateDFSNumbers();
+        if (Nodes != nullptr && !selectingHoists() && LI->end() - LI->begin() > 1)
+        {
+            for (auto li: *LI)
+            {
+                Nodes->async(numaNodeOf(li->getHeader()), [li, &mDT] { licmLoopNest(li, &mDT); });
+            }
+            Nodes->wait();
+            continue;
+        }
+        if (Pool != nullptr && !selectingHoists() && LI->end() - LI->begin() > 1)
+        {
+            for (auto li: *LI)
+            {
+                Pool->async([li, &mDT] { licmLoopNest(li, &mDT); });
+            }
+            Pool->wait();
+            continue;
+        }
+        for (auto li: *LI)
+        {
+            //li is a Loop*, consider each one
+            if(li == nullptr) continue;
+            licmLoopNest(li, &mDT);
+        }
+    }
+    if (!DryRun && SpecializeCalls)
+        specializeCalls(M);
+    numStats(M);
+    functionScratch().release();
+}
+
+/*This function returns why the load instruction cannot be hoisted, or
+  HB_None if its safe to hoist it. sawStore is set when the loop has a store
+  that may alias with other loads. Instructions in Hoisted count as already
+  moved out of the loop, which lets -dry-run predict later rounds.*/
+static HoistBlocker loadHoistBlocker(Loop *L, Instruction *I, DominatorTree *DT, bool &sawStore,
+                                     const SmallPtrSetImpl<Instruction *> *Hoisted) {
+
+    /*Check if Instruction is volatile*/
+    if (I->isVolatile()) return HB_Volatile;
+
+    /*Check if loop contains a call or invoke that may write memory*/
+    for (auto bb: L->blocks()) {
+        if(bb->empty()) continue;
+        for (auto i = bb->begin(); i != bb->end();i++) {
+            Instruction *Inst = &*i;
+            if (isa<CallBase>(Inst) && callBlocksLoadHoist(cast<CallBase>(Inst))) {
+                return HB_Call;
+            }
+        }
+    }
+
+    Value *addr = I->getOperand(0);
+
+    /*addr is a GlobalVariable and there are no possible stores to addr in L*/
+    if ((isa<Constant>(addr)) || (isa<AllocaInst>(addr)))
+    {
+
+        //check if the loop has any conflicting store
+        for (auto bb: L->blocks()) {
+            if(bb->empty()) continue;
+            for (auto i = bb->begin(); i != bb->end();i++) {
+                Instruction *Inst = &*i;
+                if (Inst->getOpcode() == Instruction::Store) {
+                    if((!(isa<Constant>(Inst->getOperand(1)))) && (!(isa<AllocaInst>(Inst->getOperand(1))))) {
+                        sawStore = true;
+                       // return false;
+                    }
+                    if (Inst->getOperand(1) == addr) {
+                        sawStore = true;
+                        return HB_Store;
+                    }
+                }
+            }
+        }
+
+        if (isa<AllocaInst>(addr))
+        {
+            //additional check for alloca
+            //check if addr instruction is in loop
+            if(instrIsInLoop(L, cast<Instruction>(addr)) && !(Hoisted && Hoisted->count(cast<Instruction>(addr))))
+                return HB_VariantAddr;
+        }
+
+        return HB_None;
+    }
+    /*there are no possible stores to any addr in L && addr is loop invariant && I dominates L’s exit*/
+    else {
+        //check if the loop has a store
+        for (auto bb: L->blocks()) {
+            if(bb->empty()) continue;
+            for (auto i = bb->begin(); i != bb->end();i++) {
+                Instruction *Inst = &*i;
+                if (Inst->getOpcode() == Instruction::Store) {
+                    sawStore = true;
+                    return HB_Store;
+                }
+            }
+        }
+
+        //check in instruction is in loop
+        if(isa<Instruction>(addr) && instrIsInLoop(L, cast<Instruction>(addr)) &&
+           !(Hoisted && Hoisted->count(cast<Instruction>(addr))))
+            return HB_VariantAddr;
+
+        //check if the block containing instruction dominates all loop exits
+        for (auto bb: L->blocks()) {
+            if (isLoopExitingBlock(L, bb)) {
+                if (!DT->dominates(I->getParent(), bb)) {
+                    return HB_Exit;
+                }
+            }
+        }
+        return HB_None;
+    }
+}
+
+/*This function returns true if its safe to hoist the load instruction*/
+bool canMoveOutOfLoop(Loop *L, Instruction *I, DominatorTree *DT) {
+
+    static thread_local CountedLoop prev;
+    bool sawStore = false;
+
+    HoistBlocker Why = loadHoistBlocker(L, I, DT, sawStore);
+    if (sawStore) hasAStore = true;
+    if (Why == HB_Call && prev.firstVisit(L)) {
+        NumLoopsWithCall++;
+    }
+    return Why == HB_None;
+}
+
+/*Returns the depth of the outermost loop around I in which all operands of I
+  are invariant, or 0 if I varies in its innermost loop*/
+static unsigned invariantDepth(LoopInfoBase<BasicBlock, Loop> *LI, Instruction *I)
+{
+    unsigned depth = 0;
+    if (isa<PHINode>(I)) return 0;
+    for (Loop *L = LI->getLoopFor(I->getParent()); L != nullptr; L = L->getParentLoop()) {
+        if (!L->hasLoopInvariantOperands(I)) break;
+        depth = L->getLoopDepth();
+    }
+    return depth;
+}
+
+/*Returns why an instruction with invariant operands is still in loop L*/
+static const char *hoistBlockedReason(Loop *L, Instruction *I, DominatorTree *DT)
+{
+    if (L->getLoopPreheader() == nullptr) return "no-preheader";
+    if (isa<LoadInst>(I)) {
+        bool sawStore = false;
+        return HoistBlockerNames[loadHoistBlocker(L, I, DT, sawStore)];
+    }
+    if (I->mayHaveSideEffects()) return "side-effects";
+    if (I->mayReadFromMemory()) return "memory";
+    if (I->isEHPad() || !isSafeToSpeculativelyExecute(I)) return "unsafe";
+    return "";
+}
+
+/*Returns why no load can be hoisted out of L at all, or "" if some could*/
+static const char *loopBlockedReason(Loop *L)
+{
+    if (L->getLoopPreheader() == nullptr) return "no-preheader";
+    bool hasStore = false;
+    for (auto bb: L->blocks()) {
+        for (auto &Inst: *bb) {
+            if (isa<CallBase>(&Inst) && callBlocksLoadHoist(cast<CallBase>(&Inst))) return "call";
+            if (isa<StoreInst>(&Inst)) hasStore = true;
+        }
+    }
+    return hasStore ? "store" : "";
+}
+
+/*Attaches the facts LICM derived to the IR so later tools can reuse them.
+  Every instruction in a loop gets
+    !p3.licm !{i32 <invariant-at-depth>, !"<hoist-blocked reason>", i1 <must-execute>}
+  where invariant-at-depth is the depth of the outermost loop in which its
+  operands are invariant (0 if none) and must-execute is set when its block
+  dominates every exit of its innermost loop. Every loop gets
+    !{!"p3.licm.loop", i32 <depth>, !"<blocked reason>"}
+  added to its !llvm.loop properties.*/
+static void annotateLoops(Module &M)
+{
+    LLVMContext &Ctx = M.getContext();
+    unsigned KindID = Ctx.getMDKindID("p3.licm");
+    Type *I32 = Type::getInt32Ty(Ctx);
+    Type *I1 = Type::getInt1Ty(Ctx);
+
+    for (auto f = M.begin(); f != M.end(); f++) {
+        if (f->empty()) continue;
+
+        FunctionScratch &S = functionScratch();
+        S.reset(*f);
+        LoopInfoBase<BasicBlock, Loop> *LI = &S.LI;
+        DominatorTree &mDT = S.DT;
+
+        for (auto L: LI->getLoopsInPreorder()) {
+            SmallVector<BasicBlock *, 8> Exiting;
+            for (auto bb: L->blocks()) {
+                if (isLoopExitingBlock(L, bb)) Exiting.push_back(bb);
+            }
+
+            for (auto bb: L->blocks()) {
+                if (LI->getLoopFor(bb) != L) continue;
+                bool mustExec = all_of(Exiting, [&](BasicBlock *E) { return mDT.dominates(bb, E); });
+                for (auto &Inst: *bb) {
+                    unsigned depth = invariantDepth(LI, &Inst);
+                    const char *reason = depth ? hoistBlockedReason(L, &Inst, &mDT) : "";
+                    Metadata *Ops[] = {ConstantAsMetadata::get(ConstantInt::get(I32, depth)),
+                                       MDString::get(Ctx, reason),
+                                       ConstantAsMetadata::get(ConstantInt::get(I1, mustExec))};
+                    Inst.setMetadata(KindID, MDTuple::get(Ctx, Ops));
+                    LICMAnnotated++;
+                }
+            }
+
+            Metadata *Ops[] = {MDString::get(Ctx, "p3.licm.loop"),
+                               ConstantAsMetadata::get(ConstantInt::get(I32, L->getLoopDepth())),
+                               MDString::get(Ctx, loopBlockedReason(L))};
+            setLoopProperty(L, MDTuple::get(Ctx, Ops));
+        }
+    }
+    functionScratch().release();
+}
@@ -0,0 +1,21 @@
+#ifndef P3_H
+#define P3_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Analysis/LoopInfo.h"
+
+/*Entry points of the LICM engine in p3.cpp. Tools that link the engine
+  compile p3.cpp with P3_NO_MAIN, which leaves out main() and the positional
+  arguments of p3 but keeps every other option registered.*/
+bool canMoveOutOfLoop(llvm::Loop *L, llvm::Instruction *I, llvm::DominatorTree *DT);
+bool instrIsInLoop(llvm::Loop *loop, llvm::Instruction *instr);
+bool mLICM(llvm::Loop *li, llvm::DominatorTree *mDT);
+void LoopInvariantCodeMotion(llvm::Module &M);
+
+/*Statistics walkers: summarize counts functions, instructions, loads and
+  stores; numStats counts the loops without loads*/
+void summarize(llvm::Module *M);
+void numStats(llvm::Module &M);
+
+#endif
@@ -0,0 +1,63 @@
+; A two-level nest for -annotate. In the inner loop %t only depends on the
+; outer induction, so it is invariant at depth 2; %v loads from an
+; invariant address but a store in the loop blocks it. The conditional
+; block %odd does not execute on every iteration.
+
+@g = global i32 0
+
+define void @f(i32* %a, i32 %n) {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j.next, %inner.latch ]
+  %t = mul i32 %i, 3
+  %v = load i32, i32* @g
+  %s = add i32 %v, %t
+  %p = getelementptr i32, i32* %a, i32 %j
+  store i32 %s, i32* %p
+  %bit = and i32 %j, 1
+  %isodd = icmp ne i32 %bit, 0
+  br i1 %isodd, label %odd, label %inner.latch
+
+odd:
+  store i32 %j, i32* @g
+  br label %inner.latch
+
+inner.latch:
+  %j.next = add i32 %j, 1
+  %jc = icmp slt i32 %j.next, %n
+  br i1 %jc, label %inner, label %outer.latch
+
+outer.latch:
+  %i.next = add i32 %i, 1
+  %ic = icmp slt i32 %i.next, %n
+  br i1 %ic, label %outer, label %exit
+
+exit:
+  ret void
+}
+
+; CHECK-LABEL: inner:
+; CHECK: %t = mul i32 %i, 3, !p3.licm [[DEPTH2:![0-9]+]]
+; CHECK-NEXT: %v = load i32, i32* @g, align 4, !p3.licm [[BLOCKED:![0-9]+]]
+; CHECK-NEXT: %s = add i32 %v, %t, !p3.licm [[ALWAYS:![0-9]+]]
+; CHECK-LABEL: odd:
+; CHECK-NEXT: store i32 %j, i32* @g, align 4, !p3.licm [[SOMETIMES:![0-9]+]]
+; CHECK-LABEL: inner.latch:
+; CHECK: br i1 %jc, label %inner, label %outer.latch, !llvm.loop [[INNER:![0-9]+]], !p3.licm [[ALWAYS]]
+; CHECK-LABEL: outer.latch:
+; CHECK: br i1 %ic, label %outer, label %exit, !llvm.loop [[OUTER:![0-9]+]], !p3.licm [[ALWAYS]]
+
+; CHECK: [[ALWAYS]] = !{i32 0, !"", i1 true}
+; CHECK: [[DEPTH2]] = !{i32 2, !"", i1 true}
+; CHECK: [[BLOCKED]] = !{i32 1, !"store", i1 true}
+; CHECK: [[SOMETIMES]] = !{i32 0, !"", i1 false}
+; CHECK: [[INNER]] = distinct !{[[INNER]], [[INNERPROP:![0-9]+]]}
+; CHECK-NEXT: [[INNERPROP]] = !{!"p3.licm.loop", i32 2, !"store"}
+; CHECK-NEXT: [[OUTER]] = distinct !{[[OUTER]], [[OUTERPROP:![0-9]+]]}
+; CHECK-NEXT: [[OUTERPROP]] = !{!"p3.licm.loop", i32 1, !"store"}
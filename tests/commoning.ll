@@ -0,0 +1,80 @@
+; A three-point stencil loads a[i-1], a[i] and a[i+1]. The first two were
+; loaded as a[i+1] one and two iterations earlier and are carried in phis.
+; In @g an atomicrmw updates a[i+1] after it is loaded, so the value loaded
+; earlier is stale and the loads stay.
+
+define void @f(float* noalias %a, float* noalias %b, i64 %n) {
+entry:
+  br label %body
+
+body:
+  %i = phi i64 [ 1, %entry ], [ %i.next, %body ]
+  %im1 = sub i64 %i, 1
+  %ip1 = add i64 %i, 1
+  %pl = getelementptr float, float* %a, i64 %im1
+  %pc = getelementptr float, float* %a, i64 %i
+  %pr = getelementptr float, float* %a, i64 %ip1
+  %l = load float, float* %pl
+  %c = load float, float* %pc
+  %r = load float, float* %pr
+  %s1 = fadd float %l, %c
+  %s2 = fadd float %s1, %r
+  %pb = getelementptr float, float* %b, i64 %i
+  store float %s2, float* %pb
+  %i.next = add i64 %i, 1
+  %cmp = icmp slt i64 %i.next, %n
+  br i1 %cmp, label %body, label %exit
+
+exit:
+  ret void
+}
+
+
+define void @g(i32* noalias %a, i32* noalias %b, i64 %n) {
+entry:
+  br label %body
+
+body:
+  %i = phi i64 [ 1, %entry ], [ %i.next, %body ]
+  %im1 = sub i64 %i, 1
+  %ip1 = add i64 %i, 1
+  %pl = getelementptr i32, i32* %a, i64 %im1
+  %pc = getelementptr i32, i32* %a, i64 %i
+  %pr = getelementptr i32, i32* %a, i64 %ip1
+  %l = load i32, i32* %pl
+  %c = load i32, i32* %pc
+  %r = load i32, i32* %pr
+  %old = atomicrmw add i32* %pr, i32 1 monotonic
+  %s1 = add i32 %l, %c
+  %s2 = add i32 %s1, %r
+  %pb = getelementptr i32, i32* %b, i64 %i
+  store i32 %s2, i32* %pb
+  %i.next = add i64 %i, 1
+  %cmp = icmp slt i64 %i.next, %n
+  br i1 %cmp, label %body, label %exit
+
+exit:
+  ret void
+}
+
+; a[0] and a[1] are loaded in the preheader for the first iteration; after
+; that a[i] is the previous a[i+1] and a[i-1] the one before.
+; CHECK-LABEL: define void @f(
+; CHECK: entry:
+; CHECK-NEXT: [[P1:%[a-z0-9]+]] = getelementptr float, float* %a, i64 1
+; CHECK-NEXT: %c.init = load float, float* [[P1]]
+; CHECK-NEXT: %l.init = load float, float* %a
+; CHECK-LABEL: body:
+; CHECK-NEXT: %l.carried = phi float [ %l.init, %entry ], [ %c.carried, %body ]
+; CHECK-NEXT: %c.carried = phi float [ %c.init, %entry ], [ %r, %body ]
+; CHECK-NOT: %l = load
+; CHECK-NOT: %c = load
+; CHECK: %r = load float, float* %pr
+; CHECK-NEXT: %s1 = fadd float %l.carried, %c.carried
+; CHECK-NEXT: %s2 = fadd float %s1, %r
+
+; CHECK-LABEL: define void @g(
+; CHECK-NOT: phi i32
+; CHECK: %l = load i32, i32* %pl
+; CHECK-NEXT: %c = load i32, i32* %pc
+; CHECK-NEXT: %r = load i32, i32* %pr
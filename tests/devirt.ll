@@ -0,0 +1,123 @@
+; The virtual call through %obj reloads the vtable and slot every iteration
+; and, as an unknown call, keeps the load of @g in the loop. -devirtualize
+; hoists both vtable loads and versions the loop for @get_a, which takes
+; 90% of the profiled calls; in that copy the load of @g is hoisted.
+; In @h the target may also come from @hook, which the loop may change, so
+; none of the target's operands leave the loop. @k's profile has counts whose
+; percentages do not fit 64 bits; @get_a still takes 90% of its calls.
+
+%struct.A = type { i32 (%struct.A*, i32)** }
+
+@g = global i32 0
+
+define i32 @get_a(%struct.A* %this, i32 %x) readnone nounwind {
+entry:
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+define i32 @get_b(%struct.A* %this, i32 %x) readnone nounwind {
+entry:
+  %r = mul i32 %x, 3
+  ret i32 %r
+}
+
+define i32 @f(%struct.A* %obj, i32 %n) {
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  %sum = phi i32 [ 0, %entry ], [ %sum.next, %body ]
+  %vptr = getelementptr inbounds %struct.A, %struct.A* %obj, i32 0, i32 0
+  %vtable = load i32 (%struct.A*, i32)**, i32 (%struct.A*, i32)*** %vptr, !invariant.group !0
+  %slot = getelementptr inbounds i32 (%struct.A*, i32)*, i32 (%struct.A*, i32)** %vtable, i64 1
+  %fn = load i32 (%struct.A*, i32)*, i32 (%struct.A*, i32)** %slot
+  %v = call i32 %fn(%struct.A* %obj, i32 %i), !prof !1
+  %k = load i32, i32* @g
+  %t = add i32 %v, %k
+  %sum.next = add i32 %sum, %t
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %body, label %exit
+
+exit:
+  ret i32 %sum.next
+}
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: entry:
+; CHECK: %vtable = load {{.*}} !invariant.group
+; CHECK: %fn = load
+; CHECK: %devirt = icmp eq {{.*}} %fn, @get_a
+; CHECK-NEXT: br i1 %devirt, label %[[FAST:[^,]+]], label %[[SLOW:[^,]+]]
+; CHECK: [[FAST]]:
+; CHECK-NEXT: load i32, i32* @g
+; CHECK: body.devirt:
+; CHECK-NOT: load
+; CHECK: call i32 @get_a(
+; CHECK: [[SLOW]]:
+; CHECK: body:
+; CHECK: call i32 %fn(
+; CHECK-NEXT: load i32, i32* @g
+
+@hook = global i32 (%struct.A*, i32)* null
+
+define i32 @h(%struct.A* %obj, i1 %own, i32 %n) {
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  %sum = phi i32 [ 0, %entry ], [ %sum.next, %body ]
+  %vptr = getelementptr inbounds %struct.A, %struct.A* %obj, i32 0, i32 0
+  %vtable = load i32 (%struct.A*, i32)**, i32 (%struct.A*, i32)*** %vptr, !invariant.group !0
+  %slot = getelementptr inbounds i32 (%struct.A*, i32)*, i32 (%struct.A*, i32)** %vtable, i64 1
+  %own.fn = load i32 (%struct.A*, i32)*, i32 (%struct.A*, i32)** %slot
+  %hook.fn = load i32 (%struct.A*, i32)*, i32 (%struct.A*, i32)** @hook
+  %fn = select i1 %own, i32 (%struct.A*, i32)* %own.fn, i32 (%struct.A*, i32)* %hook.fn
+  %v = call i32 %fn(%struct.A* %obj, i32 %i)
+  %sum.next = add i32 %sum, %v
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %body, label %exit
+
+exit:
+  ret i32 %sum.next
+}
+
+; CHECK-LABEL: define i32 @h(
+; CHECK: body:
+; CHECK: %vtable = load {{.*}} !invariant.group
+; CHECK: %own.fn = load
+; CHECK: %hook.fn = load
+; CHECK: call i32 %fn(
+
+define i32 @k(%struct.A* %obj, i32 %n) {
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  %sum = phi i32 [ 0, %entry ], [ %sum.next, %body ]
+  %vptr = getelementptr inbounds %struct.A, %struct.A* %obj, i32 0, i32 0
+  %vtable = load i32 (%struct.A*, i32)**, i32 (%struct.A*, i32)*** %vptr, !invariant.group !0
+  %slot = getelementptr inbounds i32 (%struct.A*, i32)*, i32 (%struct.A*, i32)** %vtable, i64 1
+  %fn = load i32 (%struct.A*, i32)*, i32 (%struct.A*, i32)** %slot
+  %v = call i32 %fn(%struct.A* %obj, i32 %i), !prof !2
+  %sum.next = add i32 %sum, %v
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %body, label %exit
+
+exit:
+  ret i32 %sum.next
+}
+
+; CHECK-LABEL: define i32 @k(
+; CHECK: %devirt = icmp eq {{.*}} %fn, @get_a
+; CHECK: call i32 @get_a(
+
+!0 = !{}
+!1 = !{!"VP", i32 0, i64 100, i64 -4236041660097234553, i64 90, i64 8434050236076756841, i64 10}
+!2 = !{!"VP", i32 0, i64 4611686018427387904, i64 -4236041660097234553, i64 4150517416584649113, i64 8434050236076756841, i64 461168601842738791}
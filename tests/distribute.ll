@@ -0,0 +1,43 @@
+; The store to @out keeps the load of %p, which never points into @out, in
+; the loop. Distribution moves the stores into a loop of their own.
+
+@out = global [100 x i32] zeroinitializer
+
+define i32 @f(i32* noalias %p, i32 %n) {
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  %s = phi i32 [ 0, %entry ], [ %s.next, %body ]
+  %g = getelementptr [100 x i32], [100 x i32]* @out, i32 0, i32 %i
+  store i32 %i, i32* %g
+  %v = load i32, i32* %p
+  %s.next = add i32 %s, %v
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %body, label %exit
+
+exit:
+  %r = phi i32 [ %s.next, %body ]
+  ret i32 %r
+}
+
+; The stores run first in a loop of their own, then the load is hoisted in
+; front of the remaining loop.
+; CHECK-LABEL: define i32 @f(
+; CHECK: body.dist:
+; CHECK-NEXT: %i.dist = phi i32 [ 0, %entry.split.dist ], [ %i.next.dist, %body.dist ]
+; CHECK-NEXT: %g.dist = getelementptr [100 x i32], [100 x i32]* @out, i32 0, i32 %i.dist
+; CHECK-NEXT: store i32 %i.dist, i32* %g.dist
+; CHECK-NOT: load
+; CHECK: br i1 %c.dist, label %body.dist, label %entry.split
+; CHECK: entry.split:
+; CHECK-NEXT: [[V:%[0-9]+]] = load i32, i32* %p
+; CHECK-NEXT: br label %body
+; CHECK: body:
+; CHECK-NOT: store
+; CHECK: %s.next = add i32 %s, [[V]]
+; CHECK: br i1 %c, label %body, label %exit
+; CHECK: exit:
+; CHECK-NEXT: %r = phi i32 [ %s.next, %body ]
@@ -0,0 +1,34 @@
+; A two-deep nest whose inner loop computes %m from arguments and loads @g.
+; Both leave the inner loop into its preheader and then the outer loop into
+; the function entry, so each is hoisted twice and -dry-run must count both.
+
+@g = global i32 0
+
+define i32 @f(i32 %n, i32 %a, i32 %b) {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+  %acc = phi i32 [ 0, %entry ], [ %s.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+  %s = phi i32 [ %acc, %outer ], [ %s.next, %inner ]
+  %m = mul i32 %a, %b
+  %v = load i32, i32* @g
+  %t = add i32 %m, %v
+  %s.next = add i32 %s, %t
+  %j.next = add i32 %j, 1
+  %c1 = icmp slt i32 %j.next, %n
+  br i1 %c1, label %inner, label %outer.latch
+
+outer.latch:
+  %i.next = add i32 %i, 1
+  %c2 = icmp slt i32 %i.next, %n
+  br i1 %c2, label %outer, label %exit
+
+exit:
+  ret i32 %s.next
+}
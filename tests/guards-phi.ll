@@ -0,0 +1,43 @@
+; Both checks leave the loop for a report that receives a value through a
+; phi. The first report gets a constant, so its check moves into the
+; preheader. The second gets the induction %i, which does not exist in
+; the preheader, so its check stays in the loop.
+
+@len = global i32 0
+
+declare void @report(i32) noreturn nounwind
+
+define void @f(i32* %a, i32 %n, i32 %k) {
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %l = load i32, i32* @len
+  %oob = icmp uge i32 %k, %l
+  br i1 %oob, label %fail.len, label %check
+
+check:
+  %neg = icmp slt i32 %k, 0
+  br i1 %neg, label %fail.where, label %latch
+
+latch:
+  %p = getelementptr i32, i32* %a, i32 %i
+  store i32 %k, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %body, label %exit
+
+fail.len:
+  %what = phi i32 [ -1, %body ]
+  call void @report(i32 %what)
+  unreachable
+
+fail.where:
+  %where = phi i32 [ %i, %check ]
+  call void @report(i32 %where)
+  unreachable
+
+exit:
+  ret void
+}
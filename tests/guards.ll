@@ -0,0 +1,51 @@
+; A bounds check on an invariant index and an overflow check on invariant
+; operands guard every iteration. Both checks move into the preheader.
+
+@len = global i32 0
+
+declare void @abort() noreturn nounwind
+declare { i32, i1 } @llvm.sadd.with.overflow.i32(i32, i32)
+
+define void @f(i32* %a, i32 %n, i32 %k, i32 %b) {
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %l = load i32, i32* @len
+  %oob = icmp uge i32 %k, %l
+  br i1 %oob, label %trap, label %check
+
+check:
+  %s = call { i32, i1 } @llvm.sadd.with.overflow.i32(i32 %k, i32 %b)
+  %ov = extractvalue { i32, i1 } %s, 1
+  br i1 %ov, label %trap, label %latch
+
+latch:
+  %v = extractvalue { i32, i1 } %s, 0
+  %p = getelementptr i32, i32* %a, i32 %i
+  store i32 %v, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %body, label %exit
+
+trap:
+  call void @abort()
+  unreachable
+
+exit:
+  ret void
+}
+
+; CHECK-LABEL: define void @f(
+; CHECK: entry:
+; CHECK-NEXT: %l = load i32, i32* @len
+; CHECK-NEXT: %oob = icmp uge i32 %k, %l
+; CHECK-NEXT: br i1 %oob, label %trap, label %[[NEXT:[a-z.]+]]
+; CHECK: [[NEXT]]:
+; CHECK-NEXT: %s = call { i32, i1 } @llvm.sadd.with.overflow.i32(i32 %k, i32 %b)
+; CHECK-NEXT: %ov = extractvalue { i32, i1 } %s, 1
+; CHECK-NEXT: br i1 %ov, label %trap, label %{{[a-z.]+}}
+; CHECK: body:
+; CHECK-NOT: br i1 %{{oob|ov}}
+; CHECK: trap:
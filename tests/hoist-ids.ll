@@ -0,0 +1,31 @@
+; The load of @g is invariant in both loops of the nest. It is hoisted out
+; of the inner loop first and then out of the outer loop, and both hoists
+; carry the ID of the original load.
+
+@g = global i32 0
+
+define void @f(i32* %a, i32 %n) {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+  %v = load i32, i32* @g
+  %p = getelementptr i32, i32* %a, i32 %j
+  store i32 %v, i32* %p
+  %j.next = add i32 %j, 1
+  %jc = icmp slt i32 %j.next, %n
+  br i1 %jc, label %inner, label %outer.latch
+
+outer.latch:
+  %i.next = add i32 %i, 1
+  %ic = icmp slt i32 %i.next, %n
+  br i1 %ic, label %outer, label %exit
+
+exit:
+  ret void
+}
@@ -0,0 +1,39 @@
+; The call to the small helper @scale blocks hoisting the load of @g until
+; -inline-loop-calls replaces it with the helper's body.
+
+@g = global i32 0
+
+define i32 @scale(i32 %x, i32 %k) {
+entry:
+  %m = mul i32 %x, %k
+  %r = add i32 %m, 1
+  ret i32 %r
+}
+
+define void @f(i32* %a, i32 %n) {
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  %k = load i32, i32* @g
+  %v = call i32 @scale(i32 %i, i32 %k)
+  %p = getelementptr i32, i32* %a, i32 %i
+  store i32 %v, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %body, label %exit
+
+exit:
+  ret void
+}
+
+; CHECK-LABEL: define void @f(
+; CHECK: entry:
+; CHECK-NEXT: %[[K:[0-9]+]] = load i32, i32* @g
+; CHECK: body:
+; CHECK-NOT: call
+; CHECK: %m.i = mul i32 %i, %[[K]]
+; CHECK-NEXT: %r.i = add i32 %m.i, 1
+; CHECK-NOT: call
+; CHECK: store i32 %r.i
@@ -0,0 +1,88 @@
+; In @f the inner loop walks the rows of the 64x64 matrix %a, 256 bytes
+; apart. -interchange swaps the loops so that %a is read with unit stride.
+; %b[j] is no longer invariant in the inner loop then, but the store to
+; %c[i] is, and fewer cache lines are touched per inner iteration.
+; @g stores a[i][j] and reads a[i+1][j-1], which the previous outer
+; iteration stored; the swap would reverse that dependence, so it is kept.
+
+define void @f([64 x i32]* noalias %a, i32* noalias %b, i32* noalias %c, i64 %n, i64 %m) {
+entry:
+  br label %outer
+
+outer:
+  %j = phi i64 [ 0, %entry ], [ %j.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %i = phi i64 [ 0, %outer ], [ %i.next, %inner ]
+  %pa = getelementptr [64 x i32], [64 x i32]* %a, i64 %i, i64 %j
+  %va = load i32, i32* %pa
+  %pb = getelementptr i32, i32* %b, i64 %j
+  %vb = load i32, i32* %pb
+  %pc = getelementptr i32, i32* %c, i64 %i
+  %s = add i32 %va, %vb
+  store i32 %s, i32* %pc
+  %i.next = add nsw i64 %i, 1
+  %ic = icmp slt i64 %i.next, %m
+  br i1 %ic, label %inner, label %outer.latch
+
+outer.latch:
+  %j.next = add nsw i64 %j, 1
+  %jc = icmp slt i64 %j.next, %n
+  br i1 %jc, label %outer, label %exit
+
+exit:
+  ret void
+}
+
+define void @g([64 x i32]* %a, i64 %n, i64 %m) {
+entry:
+  br label %outer
+
+outer:
+  %j = phi i64 [ 1, %entry ], [ %j.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %i = phi i64 [ 0, %outer ], [ %i.next, %inner ]
+  %i.1 = add i64 %i, 1
+  %j.1 = sub i64 %j, 1
+  %src = getelementptr [64 x i32], [64 x i32]* %a, i64 %i.1, i64 %j.1
+  %v = load i32, i32* %src
+  %dst = getelementptr [64 x i32], [64 x i32]* %a, i64 %i, i64 %j
+  store i32 %v, i32* %dst
+  %i.next = add nsw i64 %i, 1
+  %ic = icmp slt i64 %i.next, %m
+  br i1 %ic, label %inner, label %outer.latch
+
+outer.latch:
+  %j.next = add nsw i64 %j, 1
+  %jc = icmp slt i64 %j.next, %n
+  br i1 %jc, label %outer, label %exit
+
+exit:
+  ret void
+}
+
+; In @f the inductions trade places: %i now drives the outer loop and %j
+; the inner one, each with its own exit test.
+; CHECK-LABEL: define void @f(
+; CHECK: outer:
+; CHECK-NEXT: %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+; CHECK: inner:
+; CHECK-NEXT: %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+; CHECK: %pa = getelementptr [64 x i32], [64 x i32]* %a, i64 %i, i64 %j
+; CHECK: %j.next = add nsw i64 %j, 1
+; CHECK-NEXT: %jc = icmp slt i64 %j.next, %n
+; CHECK-NEXT: br i1 %jc, label %inner, label %outer.latch
+; CHECK: outer.latch:
+; CHECK-NEXT: %i.next = add nsw i64 %i, 1
+; CHECK-NEXT: %ic = icmp slt i64 %i.next, %m
+; CHECK-NEXT: br i1 %ic, label %outer, label %exit
+
+; @g keeps %j outside.
+; CHECK-LABEL: define void @g(
+; CHECK: outer:
+; CHECK-NEXT: %j = phi i64
+; CHECK: inner:
+; CHECK-NEXT: %i = phi i64
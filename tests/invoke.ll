@@ -0,0 +1,33 @@
+; A loop whose body invokes a readonly callee. The load of @g is invariant and
+; dominates the exceptional exit, so it is hoisted into the preheader.
+
+@g = global i32 0
+@sum = global i32 0
+
+declare i32 @peek(i32) readonly
+declare i32 @__gxx_personality_v0(...)
+
+define i32 @f(i32 %n) personality i32 (...)* @__gxx_personality_v0 {
+entry:
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %latch ]
+  %v = load i32, i32* @g
+  %r = invoke i32 @peek(i32 %v)
+          to label %latch unwind label %lpad
+
+latch:
+  %acc.next = add i32 %acc, %r
+  %i.next = add i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %header, label %exit
+
+exit:
+  ret i32 %acc.next
+
+lpad:
+  %lp = landingpad { i8*, i32 } cleanup
+  ret i32 -1
+}
@@ -0,0 +1,66 @@
+; %a and %b are both entered from %entry, so they form an irreducible cycle
+; without a natural loop. In @f, %m and the load of @g move into %entry.
+; In @h an atomicrmw writes @g inside the cycle, so the load stays.
+
+@g = global i32 0
+
+define i32 @f(i32 %x, i32 %y, i32 %n) {
+entry:
+  %c0 = icmp sgt i32 %n, 10
+  br i1 %c0, label %a, label %b
+
+a:
+  %i = phi i32 [ 0, %entry ], [ %j, %b ]
+  %m = mul i32 %x, %y
+  %v = load i32, i32* @g
+  %t = add i32 %i, %m
+  %u = add i32 %t, %v
+  %c = icmp slt i32 %u, %n
+  br i1 %c, label %b, label %exit
+
+b:
+  %k = phi i32 [ 1, %entry ], [ %u, %a ]
+  %j = add i32 %k, 2
+  br label %a
+
+exit:
+  ret i32 %u
+}
+
+define i32 @h(i32 %n) {
+entry:
+  %c0 = icmp sgt i32 %n, 10
+  br i1 %c0, label %a, label %b
+
+a:
+  %i = phi i32 [ 0, %entry ], [ %j, %b ]
+  %v = load i32, i32* @g
+  %old = atomicrmw add i32* @g, i32 1 seq_cst
+  %u = add i32 %i, %v
+  %c = icmp slt i32 %u, %n
+  br i1 %c, label %b, label %exit
+
+b:
+  %k = phi i32 [ 1, %entry ], [ %u, %a ]
+  %j = add i32 %k, 2
+  br label %a
+
+exit:
+  ret i32 %u
+}
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: entry:
+; CHECK-DAG: %m = mul i32 %x, %y
+; CHECK-DAG: %v = load i32, i32* @g
+; CHECK: br i1 %c0, label %a, label %b
+; CHECK: a:
+; CHECK-NOT: load
+; CHECK: b:
+
+; CHECK-LABEL: define i32 @h(
+; CHECK: entry:
+; CHECK-NOT: load
+; CHECK: a:
+; CHECK: %v = load i32, i32* @g
+; CHECK-NEXT: %old = atomicrmw add i32* @g, i32 1 seq_cst
@@ -0,0 +1,34 @@
+; Two disjoint top-level loops that each load an invariant global. With
+; -threads both nests are processed concurrently.
+
+@g = global i32 0
+@h = global i32 0
+
+define i32 @f(i32 %n) {
+entry:
+  br label %loop1
+
+loop1:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop1 ]
+  %a = phi i32 [ 0, %entry ], [ %a.next, %loop1 ]
+  %v = load i32, i32* @g
+  %a.next = add i32 %a, %v
+  %i.next = add i32 %i, 1
+  %c1 = icmp slt i32 %i.next, %n
+  br i1 %c1, label %loop1, label %mid
+
+mid:
+  br label %loop2
+
+loop2:
+  %j = phi i32 [ 0, %mid ], [ %j.next, %loop2 ]
+  %b = phi i32 [ %a.next, %mid ], [ %b.next, %loop2 ]
+  %w = load i32, i32* @h
+  %b.next = add i32 %b, %w
+  %j.next = add i32 %j, 1
+  %c2 = icmp slt i32 %j.next, %n
+  br i1 %c2, label %loop2, label %exit
+
+exit:
+  ret i32 %b.next
+}
@@ -0,0 +1,6 @@
+; A program without loops, so LICM has nothing to hoist.
+
+define i32 @main() {
+entry:
+  ret i32 0
+}
@@ -0,0 +1,46 @@
+; The first iteration initialises @g and every later iteration only reads it.
+; Peeling one iteration leaves a store-free loop, so the load is hoisted.
+
+@g = global i32 0
+
+define i32 @f(i32 %n, i32 %x) {
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %latch ]
+  %first = icmp eq i32 %i, 0
+  br i1 %first, label %init, label %latch
+
+init:
+  store i32 %x, i32* @g
+  br label %latch
+
+latch:
+  %v = load i32, i32* @g
+  %acc.next = add i32 %acc, %v
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %body, label %exit
+
+exit:
+  ret i32 %acc.next
+}
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: body.peel:
+; CHECK: init.peel:
+; CHECK-NEXT: store i32 %x, i32* @g
+; CHECK: latch.peel:
+; CHECK-NEXT: %v.peel = load i32, i32* @g
+; CHECK: [[PH:[a-z.]+newph]]:
+; CHECK-NEXT: %[[G:[0-9]+]] = load i32, i32* @g
+; CHECK-NEXT: br label %body
+; CHECK: body:
+; CHECK-NEXT: %i = phi i32 [ %i.next.peel, %[[PH]] ]
+; CHECK-NOT: store
+; CHECK: latch:
+; CHECK-NEXT: %acc.next = add i32 %acc, %[[G]]
+; CHECK-NOT: store
+; CHECK: ret i32
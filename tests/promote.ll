@@ -0,0 +1,50 @@
+; @count is updated in the inner loop of a nest. Its address is never taken,
+; so the loads and stores through %a cannot touch it, and -promote-globals
+; keeps it in a register across the whole nest, storing it once at the
+; exit of the outer loop.
+
+@count = internal global i32 0
+
+define i32 @f(i32* %a, i32 %n, i32 %m) {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+  %p = getelementptr i32, i32* %a, i32 %j
+  %x = load i32, i32* %p
+  %c = load i32, i32* @count
+  %c.next = add i32 %c, %x
+  store i32 %c.next, i32* @count
+  store i32 %c, i32* %p
+  %j.next = add nsw i32 %j, 1
+  %jc = icmp slt i32 %j.next, %m
+  br i1 %jc, label %inner, label %outer.latch
+
+outer.latch:
+  %i.next = add nsw i32 %i, 1
+  %ic = icmp slt i32 %i.next, %n
+  br i1 %ic, label %outer, label %exit
+
+exit:
+  %r = load i32, i32* @count
+  ret i32 %r
+}
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: entry:
+; CHECK-NEXT: %count.promoted = load i32, i32* @count
+; CHECK: outer:
+; CHECK-NEXT: %count = phi i32 [ %count.promoted, %entry ], [ %c.next, %outer.latch ]
+; CHECK: inner:
+; CHECK-NEXT: %count1 = phi i32 [ %count, %outer ], [ %c.next, %inner ]
+; CHECK-NOT: @count
+; CHECK: %c.next = add i32 %count1, %x
+; CHECK-NOT: @count
+; CHECK: exit:
+; CHECK-NEXT: store i32 %c.next, i32* @count
+; CHECK-NEXT: %r = load i32, i32* @count
@@ -0,0 +1,34 @@
+; A for loop that exits from the header. The load in the body does not
+; dominate the header exit until the loop is rotated into do-while form.
+
+define i32 @f(i32* %p, i32 %n) {
+entry:
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %body ]
+  %c = icmp slt i32 %i, %n
+  br i1 %c, label %body, label %exit
+
+body:
+  %v = load i32, i32* %p
+  %acc.next = add i32 %acc, %v
+  %i.next = add i32 %i, 1
+  br label %header
+
+exit:
+  ret i32 %acc
+}
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: entry:
+; CHECK: br i1 %{{[a-z0-9.]+}}, label %[[PH:[a-z.]+]], label %exit
+; CHECK: [[PH]]:
+; CHECK-NEXT: %[[V:[0-9]+]] = load i32, i32* %p
+; CHECK: body:
+; CHECK-NOT: load
+; CHECK: %acc.next = add i32 %{{[a-z0-9.]+}}, %[[V]]
+; CHECK: %c = icmp slt i32 %i.next, %n
+; CHECK-NEXT: br i1 %c, label %body, label %{{[a-z._]+}}
+; CHECK-NOT: header:
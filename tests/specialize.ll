@@ -0,0 +1,41 @@
+; @norm is called in the loop with the constant %n = 4 and the invariant
+; %k. The clone for %n = 4 computes %s and %t from %k on every call; both
+; move into the preheader. The specialized call keeps the attributes and
+; the tail marker of the original call.
+
+define i32 @norm(i32* %p, i32 %k, i32 %n) {
+entry:
+  %s = mul i32 %k, %k
+  %t = add i32 %s, 7
+  %v = load i32, i32* %p
+  %w = mul i32 %v, %t
+  %x = shl i32 %w, %n
+  ret i32 %x
+}
+
+define void @f(i32* %a, i32 %k, i32 %m) {
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  %p = getelementptr i32, i32* %a, i32 %i
+  %v = tail call i32 @norm(i32* nonnull %p, i32 %k, i32 4) #0
+  store i32 %v, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %m
+  br i1 %c, label %body, label %exit
+
+exit:
+  ret void
+}
+
+attributes #0 = { nounwind }
+
+; CHECK-LABEL: define void @f(
+; CHECK: %s = mul i32 %k, %k
+; CHECK-NEXT: %t = add i32 %s, 7
+; CHECK: %v = tail call i32 @norm.const.setup(i32* nonnull %p, i32 %k, i32 %t) [[ATTRS:#[0-9]+]]
+; CHECK: define internal i32 @norm.const.setup(i32* %p, i32 %k, i32 %t.in)
+; CHECK: %x = shl i32 %w, 4
+; CHECK: attributes [[ATTRS]] = { nounwind }
@@ -0,0 +1,22 @@
+; A small deterministic program for the p3-tune smoke test.
+
+@g = global i32 3
+
+define i32 @main() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  %v = load i32, i32* @g
+  %acc.next = add i32 %acc, %v
+  %i.next = add i32 %i, 1
+  %c = icmp slt i32 %i.next, 1000
+  br i1 %c, label %loop, label %exit
+
+exit:
+  %r = icmp eq i32 %acc.next, 3000
+  %rc = select i1 %r, i32 0, i32 1
+  ret i32 %rc
+}